@@ -6,6 +6,7 @@
 #include "scheduler.h"
 
 #include <clock/clock.h>
+#include <clock/hirestimer.h>
 #include <log4cpp/Category.hh>
 #include <webserver/server.h>
 #include <webserver/incominghttpmessage.h>
@@ -83,6 +84,9 @@ namespace demo {
   #define DEMO_CONNECTION_TIMEOUT 10
   #define DEMO_BACKLOG_SIZE 100
   #define DEMO_WORKERS_COUNT 10
+  // Requests taking 100 ms or longer are logged, one in ten of them.
+  #define DEMO_SLOW_REQUEST_THRESHOLD 100000
+  #define DEMO_SLOW_REQUEST_SAMPLING 10
   
   #define DEMO_HOSTNAME "localhost"
   #define DEMO_PORT 9000
@@ -95,8 +99,12 @@ namespace demo {
     logger.info("Starting processing workers.");
 
     http_listener_ = webserver::Server::CreateListener<webserver::HttpListener>(DEMO_HOSTNAME, DEMO_PORT, DEMO_BACKLOG_SIZE);
+
+    slow_requests_ = webserver::SlowRequestLog::sptr(new webserver::SlowRequestLog(DEMO_SLOW_REQUEST_THRESHOLD, DEMO_SLOW_REQUEST_SAMPLING));
+    slow_requests_->AddHeader("User-Agent");
+    slow_requests_->AddHeader("X-Request-Id");
     for (unsigned int i = 0; i < DEMO_WORKERS_COUNT; ++i) {
-      std::tr1::shared_ptr<threads::Thread<HttpWorker> > worker = HttpWorker::Create(http_listener_);
+      std::tr1::shared_ptr<threads::Thread<HttpWorker> > worker = HttpWorker::Create(http_listener_, slow_requests_);
       http_pool_.push_back(worker);
     }
   }
@@ -43,6 +43,7 @@ namespace demo {
     HttpPool http_pool_;
 
     std::tr1::shared_ptr<threads::Thread<webserver::HttpListener> > http_listener_;
+    webserver::SlowRequestLog::sptr slow_requests_;
   };
 
   typedef threads::Singleton<_Scheduler> Scheduler;
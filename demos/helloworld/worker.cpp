@@ -21,9 +21,11 @@ namespace demo {
   HttpWorker::~HttpWorker() { }
 
 
-  shared_ptr<threads::Thread<HttpWorker> > HttpWorker::Create(shared_ptr<threads::Thread<webserver::HttpListener> >& listener) {
+  shared_ptr<threads::Thread<HttpWorker> > HttpWorker::Create(shared_ptr<threads::Thread<webserver::HttpListener> >& listener,
+                                                              const webserver::SlowRequestLog::sptr& slow_requests) {
     shared_ptr<threads::Thread<HttpWorker> > w = shared_ptr<threads::Thread<HttpWorker> >(new threads::Thread<HttpWorker>(false));
     webserver::Server::sptr s = webserver::Server::Create(listener);
+    s->SetSlowRequestLog(slow_requests);
     w->SetServer(s);
     w->Start();
     return w;
@@ -45,7 +47,7 @@ namespace demo {
         const std::string& uri = request->GetUri();
         
         try {
-          if (request->GetMethod() == webserver::GET) {
+          if (request->GetMethod() == webserver::GET || request->GetMethod() == webserver::HEAD) {
             std::string str = std::string("Huge dust coma uniform rotating Saros, and time waiting for a response amounted to 80 billion years. "
                               "Height, sublimipuya with povephnosti yadpa comets observable. Solar eclipse selects a population close to the index, "
                               "this last Saturday, deputy administrator NASA. Many comets have two tails, but the eccentricity is traditionally "
@@ -56,29 +58,23 @@ namespace demo {
             webserver::OutgoingHttpMessage::sptr response = webserver::OutgoingHttpMessage::sptr(new webserver::OutgoingHttpMessage());
             response->SetMethod(webserver::RESPONSE);
             response->SetPersistence(connection->IsPersistent());
-            response->SetData(str.c_str(), str.length());
+            response->SetHeadOnly(request->GetMethod() == webserver::HEAD);
+            response->SwapData(str);
             response->SetResponseCode(webserver::HTTP_OK);
+            response->AddHeader("Content-Type", "text/plain; charset=utf-8");
+            response->Compress(*request);
             
-            connection->SendMessage(response);
-            
-            /*
-            const clocks::HiResTimer& t = request->GetTimer().Mark();
-            if (t.GetDifferenceNanoseconds() / 1000u >= Scheduler::Self()->GetConfig().GetSlowQueryThreshold()) {
-              log4cpp::Category& slowquerylog = log4cpp::Category::getInstance(string("slowquerylog"));
-              slowquerylog.warnStream() << "Request " << mrq.GetRequestId() << " was completed in "
-              << t << ". Response was: " << response->GetSerializedMessage();
-            }
-            */
+            connection->SendMessage(response, *i);
           }
           else {
-            connection->SendMessage(webserver::OutgoingHttpMessage::NotAcceptable(c_format("Unhandled request method %i", request->GetMethod()), connection->IsPersistent()));
+            connection->SendMessage(webserver::OutgoingHttpMessage::NotAcceptable(c_format("Unhandled request method %i", request->GetMethod()), connection->IsPersistent()), *i);
             if (connection->IsConnected()) {
               break;
             }
           }
         }
         catch (...) {
-          connection->SendMessage(webserver::OutgoingHttpMessage::BadRequest());
+          connection->SendMessage(webserver::OutgoingHttpMessage::BadRequest(), *i);
           if (connection->IsConnected()) {
             break;
           }
@@ -17,7 +17,8 @@ namespace demo {
 
   class HttpWorker : public BaseWorker {
   public:
-    static std::tr1::shared_ptr<threads::Thread<HttpWorker> > Create(std::tr1::shared_ptr<threads::Thread<webserver::HttpListener> >& listener);
+    static std::tr1::shared_ptr<threads::Thread<HttpWorker> > Create(std::tr1::shared_ptr<threads::Thread<webserver::HttpListener> >& listener,
+                                                                   const webserver::SlowRequestLog::sptr& slow_requests);
   protected:
     HttpWorker();
     ~HttpWorker();
@@ -0,0 +1,47 @@
+// timestamp.cpp
+// Clocks and timers.
+// 
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "timestamp.h"
+#include "helpers.h"
+
+#include <base/exception.h>
+#include <cerrno> // for errno
+#include <cstring> // for ::strerror
+#include <ctime>
+
+extern "C" {
+#ifdef HAVE_MACH_MACH_TIME_H
+# include <mach/mach_time.h> // for ::mach_absolute_time, mach_timebase_info_data_t
+#else
+# include <sys/time.h> // for ::gettimeofday
+#endif
+}
+
+
+namespace clocks {
+
+  Timestamp Timestamp::Now() {
+#ifdef HAVE_CLOCK_GETTIME
+    timespec t;
+    if (::clock_gettime(CLOCK_MONOTONIC, &t) != 0) {
+      base_throw(InternalError, ::strerror(errno));
+    }
+    return Timestamp(static_cast<uint64_t>(t.tv_sec) * nanoclock::second + t.tv_nsec);
+#elif defined HAVE_MACH_ABSOLUTE_TIME
+    static mach_timebase_info_data_t timebase;
+    if (timebase.denom == 0) {
+      ::mach_timebase_info(&timebase);
+    }
+    return Timestamp(::mach_absolute_time() * timebase.numer / timebase.denom);
+#else // GETTIMEOFDAY, which is not monotonic
+    timeval t;
+    if (::gettimeofday(&t, 0) != 0) {
+      base_throw(InternalError, ::strerror(errno));
+    }
+    return Timestamp(static_cast<uint64_t>(t.tv_sec) * nanoclock::second + t.tv_usec * nanoclock::microsecond);
+#endif
+  }
+
+} // namespace clocks
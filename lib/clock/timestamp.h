@@ -0,0 +1,64 @@
+// timestamp.h
+// Clocks and timers.
+// 
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef CLOCK_TIMESTAMP_H__
+#define CLOCK_TIMESTAMP_H__
+
+#include <inttypes.h>
+
+
+namespace clocks {
+
+  //
+  // Point in monotonic time, in nanoseconds, small enough to be copied and embedded by
+  // value. Default one is not set: it reads zero, which no clock reading gives.
+  //
+
+  class Timestamp {
+  public:
+    Timestamp();
+    explicit Timestamp(const uint64_t nanoseconds);
+
+    static Timestamp Now();
+
+    bool IsSet() const;
+    uint64_t GetNanoseconds() const;
+    // Nanoseconds from this to later, zero unless both are set and later is not earlier.
+    uint64_t NanosecondsTo(const Timestamp& later) const;
+
+  private:
+    uint64_t nanoseconds_;
+  };
+
+
+  inline Timestamp::Timestamp()
+  : nanoseconds_(0) { }
+
+
+  inline Timestamp::Timestamp(const uint64_t nanoseconds)
+  : nanoseconds_(nanoseconds) { }
+
+
+  inline bool Timestamp::IsSet() const {
+    return nanoseconds_ != 0;
+  }
+
+
+  inline uint64_t Timestamp::GetNanoseconds() const {
+    return nanoseconds_;
+  }
+
+
+  inline uint64_t Timestamp::NanosecondsTo(const Timestamp& later) const {
+    if (nanoseconds_ == 0 || later.nanoseconds_ < nanoseconds_) {
+      return 0;
+    }
+
+    return later.nanoseconds_ - nanoseconds_;
+  }
+
+} // namespace clocks
+
+#endif // CLOCK_TIMESTAMP_H__
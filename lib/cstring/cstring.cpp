@@ -10,6 +10,78 @@
 
 namespace base {
 
+  namespace {
+
+    // Value of hexadecimal digit, or -1 for other characters.
+    const signed char HEX_VALUE[256] = {
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+       0,  1,  2,  3,  4,  5,  6,  7,  8,  9, -1, -1, -1, -1, -1, -1,
+      -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, 10, 11, 12, 13, 14, 15, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1,
+      -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1, -1
+    };
+
+    typedef enum {
+      QUERY_PLAIN,
+      QUERY_PERCENT,
+      QUERY_PLUS,
+      QUERY_EQUALS,
+      QUERY_AMPERSAND
+    } QueryCharClass;
+
+    // Class of every character for query tokenizing, most of them are plain ones.
+    class QueryCharClasses {
+    public:
+      QueryCharClasses() {
+        ::memset(classes_, QUERY_PLAIN, sizeof(classes_));
+        classes_[static_cast<unsigned char>('%')] = QUERY_PERCENT;
+        classes_[static_cast<unsigned char>('+')] = QUERY_PLUS;
+        classes_[static_cast<unsigned char>('=')] = QUERY_EQUALS;
+        classes_[static_cast<unsigned char>('&')] = QUERY_AMPERSAND;
+      }
+
+      unsigned char operator[](const char c) const {
+        return classes_[static_cast<unsigned char>(c)];
+      }
+
+    private:
+      unsigned char classes_[256];
+    };
+
+    const QueryCharClasses QUERY_CHAR_CLASS;
+
+
+    // Decodes escape at p, if it is a valid one.
+    inline bool DecodeEscape(const char* p, const char* end, char& c) {
+      if (end - p < 3) {
+        return false;
+      }
+
+      const signed char high = HEX_VALUE[static_cast<unsigned char>(p[1])];
+      const signed char low = HEX_VALUE[static_cast<unsigned char>(p[2])];
+
+      if (high < 0 || low < 0) {
+        return false;
+      }
+
+      c = static_cast<char>((high << 4) | low);
+      return true;
+    }
+
+  } // namespace
+
+
   const size_t CString::npos = static_cast<size_t>(-1);
 
   std::ostream& operator<< (std::ostream& os, const CString& str) {
@@ -376,24 +448,43 @@ namespace base {
 
 
   CString& CString::UrlDecode() {
+    if (length_ == 0) {
+      return *this;
+    }
+
     const char* src = string_;
+    const char* const end = string_ + length_;
     char* dst = string_;
-    char tmp[3];
-    tmp[2] = '\0';
-
-    while (*src) {
-      if (*src == '%' && src[1] != '\0' && src[2] != '\0') {
-        src++;
-        tmp[0] = *src++;
-        tmp[1] = *src++;
-        *dst++ = static_cast<char>(::strtol(tmp, 0, 16));
-        length_ -= 2;
-        reserved_ += 2;
-      } else {
-        *dst++ = *src++;
+    const char* escape;
+
+    // Plain runs between escapes are moved at once.
+    while ((escape = static_cast<const char*>(::memchr(src, '%', end - src))) != 0) {
+      const size_t run = escape - src;
+      if (dst != src) {
+        ::memmove(dst, src, run);
+      }
+      dst += run;
+      src = escape;
+
+      if (DecodeEscape(src, end, *dst)) {
+        src += 3;
+      }
+      else {
+        *dst = *src++;
       }
+      ++dst;
+    }
+
+    const size_t run = end - src;
+    if (dst != src) {
+      ::memmove(dst, src, run);
     }
-    *dst++ = '\0';
+    dst += run;
+
+    const size_t length = dst - string_;
+    reserved_ += length_ - length;
+    length_ = length;
+    string_[length_] = '\0';
 
     return *this;
   }
@@ -428,6 +519,70 @@ namespace base {
     string_[length_] = '\0';
   }
 
-} // namespace base
 
+  QueryTokenizer::QueryTokenizer(const char* query, const size_t len)
+  : p_(query)
+  , end_(query + len) {
+    if (p_ != end_ && *p_ == '?') {
+      ++p_;
+    }
+  }
 
+
+  bool QueryTokenizer::Next(std::string& key, std::string& value) {
+    while (p_ < end_) {
+      key.clear();
+      value.clear();
+
+      std::string* out = &key;
+      const char* run = p_;
+
+      // Plain characters are collected into runs, which are appended at once.
+      for (; p_ < end_; ++p_) {
+        const unsigned char c = QUERY_CHAR_CLASS[*p_];
+
+        if (c == QUERY_PLAIN || (c == QUERY_EQUALS && out == &value)) {
+          continue;
+        }
+
+        out->append(run, p_ - run);
+
+        if (c == QUERY_AMPERSAND) {
+          break;
+        }
+        else if (c == QUERY_EQUALS) {
+          out = &value;
+        }
+        else if (c == QUERY_PLUS) {
+          out->push_back(' ');
+        }
+        else {
+          char decoded;
+          if (DecodeEscape(p_, end_, decoded)) {
+            out->push_back(decoded);
+            p_ += 2;
+          }
+          else {
+            out->push_back('%');
+          }
+        }
+
+        run = p_ + 1;
+      }
+
+      if (p_ < end_) {
+        ++p_; // '&'
+      }
+      else {
+        out->append(run, p_ - run);
+      }
+
+      if (!key.empty() && !value.empty()) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+} // namespace base
@@ -185,6 +185,24 @@ namespace base {
     return Append(str, chars);
   }
 
+  //
+  // Splits query string "key=value&key=value" into pairs and percent-decodes them in a single
+  // pass. '+' is decoded as space, malformed escapes are kept as is, leading '?' is skipped.
+  // Pairs with empty key or value are skipped.
+  //
+
+  class QueryTokenizer {
+  public:
+    QueryTokenizer(const char* query, const size_t len);
+
+    // Decodes the next pair into key and value, returns false at the end of query.
+    bool Next(std::string& key, std::string& value);
+
+  private:
+    const char* p_;
+    const char* end_;
+  };
+
   std::ostream& operator<< (std::ostream& os, const CString& str);
   base::CString operator+(const base::CString& x, const base::CString& y);
 
@@ -7,6 +7,7 @@
 #define IO_POLL_H__
 
 #include <base/prototype.h>
+#include <inttypes.h>
 #include <sys/types.h>
 
 namespace io {
@@ -45,7 +46,15 @@ namespace io {
     virtual void RemoveWrite(Event* event) = 0;
     virtual void RemoveError(Event* event) = 0;
 
+    // Calls changing the kernel's interest set made so far.
+    uint64_t GetControlCalls() const { return control_calls_; }
+
     // Add one for HUP? Or would that be in event?
+
+  protected:
+    Poll() : control_calls_(0) { }
+
+    uint64_t control_calls_;
   };
 
 } // namespace io
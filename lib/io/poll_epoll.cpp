@@ -209,6 +209,7 @@ namespace io {
     e.events = mask;
 
     SetEventMask_(event, mask);
+    ++control_calls_;
 
     if (::epoll_ctl(fd_, op, event->Descriptor(), &e)) {
       base_throw(InternalError, "epoll_ctl call failed");
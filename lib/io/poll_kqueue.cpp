@@ -219,6 +219,7 @@ namespace io {
   void PollKQueue::Modify_(Event* event, const unsigned short op, const short mask) {
     struct kevent ev;
     EV_SET(&ev, event->Descriptor(), mask, op, 0, 0, event);
+    ++control_calls_;
     if (::kevent(fd_, &ev, 1, 0, 0, 0) == -1) {
       base_throw(IOException, "PollKQueue::Modify_() error: " + errno);
     }
@@ -11,8 +11,13 @@
 extern "C" {
 #include <string.h>
 #include <sys/socket.h>
+#include <sys/uio.h>
 }
 
+#if defined(OS_LINUX)
+#include <sys/sendfile.h>
+#endif
+
 #include <base/basicmacros.h>
 #include <base/c_format.h>
 #include <cerrno>
@@ -168,6 +173,97 @@ namespace sockets {
     return r;
   }
 
+  ssize_t Socket::WriteVector(const iovec* segments, const size_t count) {
+    if (count == 0) {
+      base_throw0(ZeroWriteBufferError);
+    }
+
+    msghdr message;
+    ::memset(&message, 0, sizeof(message));
+    message.msg_iov = const_cast<iovec*>(segments);
+    message.msg_iovlen = count;
+
+#ifdef MSG_NOSIGNAL
+    const ssize_t r = ::sendmsg(fd_, &message, MSG_NOSIGNAL);
+#else
+    const ssize_t r = ::sendmsg(fd_, &message, 0);
+#endif
+
+    if (r == 0) {
+      base_throw0(ConnectionTerminatedError);
+    }
+    else if (r < 0) {
+      const int socket_errno = errno;
+      if (socket_errno == EAGAIN || socket_errno == EINTR) {
+        return 0;
+      }
+      else if (socket_errno == EWOULDBLOCK || socket_errno == ETIMEDOUT) {
+        base_throw0(ConnectionTimeoutError);
+      }
+      else if (socket_errno == ECONNRESET || socket_errno == ECONNABORTED || socket_errno == EPIPE) {
+        base_throw0(ConnectionTerminatedError);
+      }
+      else if (socket_errno == EDEADLK) {
+        base_throw0(ConnectionBlockedError);
+      }
+      else {
+        base_throw(UnknownSocketError, c_format("Connection error %d: %s", socket_errno, ::strerror(socket_errno)));
+      }
+    }
+
+    return r;
+  }
+
+  ssize_t Socket::SendFile(const int fd, const off_t offset, const size_t length) {
+    if (length == 0) {
+      base_throw0(ZeroWriteBufferError);
+    }
+
+#if defined(OS_LINUX)
+    off_t position = offset;
+    const ssize_t r = ::sendfile(fd_, fd, &position, length);
+#elif defined(OS_MACOSX)
+    // Bytes sent before the call was interrupted are reported in len.
+    off_t len = static_cast<off_t>(length);
+    ssize_t r = ::sendfile(fd, fd_, offset, &len, 0, 0);
+    if (r == 0 || len > 0) {
+      r = static_cast<ssize_t>(len);
+    }
+#else
+    static_cast<void>(fd);
+    static_cast<void>(offset);
+    errno = ENOSYS;
+    const ssize_t r = -1;
+#endif
+
+    if (r == 0) {
+      base_throw(UnknownSocketError, "File ended before all of its data was sent");
+    }
+    else if (r < 0) {
+      const int socket_errno = errno;
+      if (socket_errno == EAGAIN || socket_errno == EINTR) {
+        return 0;
+      }
+      else if (socket_errno == EINVAL || socket_errno == ENOSYS || socket_errno == EOPNOTSUPP) {
+        return -1;
+      }
+      else if (socket_errno == EWOULDBLOCK || socket_errno == ETIMEDOUT) {
+        base_throw0(ConnectionTimeoutError);
+      }
+      else if (socket_errno == ECONNRESET || socket_errno == ECONNABORTED || socket_errno == EPIPE) {
+        base_throw0(ConnectionTerminatedError);
+      }
+      else if (socket_errno == EDEADLK) {
+        base_throw0(ConnectionBlockedError);
+      }
+      else {
+        base_throw(UnknownSocketError, c_format("Connection error %d: %s", socket_errno, ::strerror(socket_errno)));
+      }
+    }
+
+    return r;
+  }
+
   ssize_t Socket::WriteStreamTo(const SocketAddress& addr, const void* buffer, const size_t length) {
     if (length == 0) {
       base_throw0(ZeroWriteBufferError);
@@ -16,6 +16,7 @@
 
 extern "C" {
 #include <sys/types.h>
+#include <sys/uio.h>
 #include <netinet/in.h>
 }
 
@@ -45,6 +46,12 @@ namespace sockets {
 
     // Writes into socket and returns amount of data written.
     ssize_t WriteStream(const void* buffer, const size_t length);
+    // Writes segments with a single system call and returns amount of data written,
+    // which may end in the middle of any segment.
+    ssize_t WriteVector(const iovec* segments, const size_t count);
+    // Sends length bytes of file starting from offset and returns amount of data sent.
+    // Returns -1 if file cannot be sent this way and has to be read by the caller.
+    ssize_t SendFile(const int fd, const off_t offset, const size_t length);
     // Writes to specified address and returns amount of data written.
     ssize_t WriteStreamTo(const SocketAddress& addr, const void* buffer, const size_t length);
   };
@@ -4,17 +4,36 @@
 
 #include "baseconnection.h"
 #include "exception.h"
+#include "filebody.h"
 #include "server.h"
 #include "status.h"
 #include <sockets/exception.h>
+#include <cerrno>
 
 namespace webserver {
 
+  namespace {
+    // Segments passed to a single write.
+    const size_t MAX_WRITE_SEGMENTS = 64;
+  }
+
+
+  const uint64_t BaseConnection::NO_SEQUENCE;
+
+
   BaseConnection::BaseConnection(const std::string& local, sockets::SocketAddress& remote, ServerSPtr& handler)
   : is_persistent_(false)
   , buffer_length_(1500)
   , buffer_(buffer_length_)
   , handler_(handler)
+  , outgoing_offset_(0)
+  , is_write_suspended_(false)
+  , next_incoming_(0)
+  , next_outgoing_(0)
+  , phases_first_(0)
+  , accepted_(0)
+  , last_read_(0)
+  , close_reason_(CLOSE_NOT_PERSISTENT)
   , logger_(log4cpp::Category::getInstance("webserver")) {
     sockets::SocketFd fd;
     if (!fd.Open() || !fd.SetReuseAddress(true)) {
@@ -56,6 +75,14 @@ namespace webserver {
   , buffer_length_(1500)
   , buffer_(buffer_length_)
   , handler_(handler)
+  , outgoing_offset_(0)
+  , is_write_suspended_(false)
+  , next_incoming_(0)
+  , next_outgoing_(0)
+  , phases_first_(0)
+  , accepted_(RequestPhases::Now())
+  , last_read_(0)
+  , close_reason_(CLOSE_NOT_PERSISTENT)
   , logger_(log4cpp::Category::getInstance("webserver")) {
     SetDescriptor(fd);
     SetOptions_();
@@ -72,20 +99,39 @@ namespace webserver {
       return;
     }
 
+    // Consumed data is released from the buffer by ProcessEventRead_(), so only an unparsed
+    // header may grow it that far.
+    if (buffer_.Length() >= handler_->GetMaxBufferLength()) {
+      GetLogger_().warnStream() << "Connection buffer exceeded " << handler_->GetMaxBufferLength() << " bytes.";
+      Close(CLOSE_PARSE_ERROR);
+      return;
+    }
+
     // Allocate buffer for socket to write to.
-    if (buffer_.Reserved() < buffer_length_ + buffer_.Length()) {
+    if (buffer_.Reserved() < buffer_length_) {
       buffer_.Reserve(buffer_length_ - buffer_.Reserved());
     }
 
     ssize_t len;
     try {
       // Append socket's data at buffer's end.
+      handler_->GetStats().Add(ServerStats::COUNTER_READS);
       len = ReadStream(buffer_.End(), buffer_length_);
       buffer_.AdjustLength(len);
     }
+    catch (const sockets::ConnectionTerminatedError& e) {
+      GetLogger_().warn("ReadStream failed with error: " + e.why());
+      Close(CLOSE_PEER);
+      return;
+    }
+    catch (const sockets::ConnectionTimeoutError& e) {
+      GetLogger_().warn("ReadStream failed with error: " + e.why());
+      Close(CLOSE_TIMEOUT);
+      return;
+    }
     catch (const sockets::SocketException& e) {
       GetLogger_().warn("ReadStream failed with error: " + e.why());
-      Close();
+      Close(CLOSE_ERROR);
       return;
     }
 
@@ -94,6 +140,7 @@ namespace webserver {
       return;
     }
 
+    last_read_ = RequestPhases::Now();
     ProcessEventRead_(buffer_);
   }
 
@@ -103,44 +150,76 @@ namespace webserver {
       return;
     }
 
-    if (outgoing_.empty()) {
+    if (outgoing_.empty() || is_write_suspended_) {
       handler_->GetPoll()->RemoveWrite(this);
       return;
     }
 
-    std::list<OutgoingMessage::sptr> outgoing;
-    outgoing.swap(outgoing_);
-
-    for (std::list<OutgoingMessage::sptr>::const_iterator i = outgoing.begin(); i != outgoing.end(); ++i) {
-      if (state_ != STATE_CONNECTED) {
-        return;
-      }
-
-      const OutgoingMessage::sptr& message = *i;
-      const char* response = message->GetSerializedMessage();
+    while (state_ == STATE_CONNECTED && !outgoing_.empty() && !is_write_suspended_) {
+      const OutgoingMessage::sptr& first = outgoing_.front().message;
+      const FileBody* file = first->GetFileBody();
+      const size_t file_start = file ? first->GetLength() - file->Length() : 0;
 
+      size_t len = 0;
       try {
-        while (WriteStream(response, message->GetLength()) == 0) {
-          threads::Yield();
+        if (file && outgoing_offset_ >= file_start && outgoing_offset_ < first->GetLength()) {
+          handler_->GetStats().Add(ServerStats::COUNTER_WRITES);
+          len = file->Send(*this, outgoing_offset_ - file_start);
         }
+        else {
+          // Gather queued messages up to and including the one which closes the connection,
+          // ends with a file or is still being streamed.
+          iovec segments[MAX_WRITE_SEGMENTS];
+          size_t count = 0;
+          size_t offset = outgoing_offset_;
+
+          for (std::list<Outgoing>::const_iterator i = outgoing_.begin(); i != outgoing_.end() && count < MAX_WRITE_SEGMENTS; ++i) {
+            count += i->message->GetSegments(offset, segments + count, MAX_WRITE_SEGMENTS - count);
+            offset = 0;
+
+            if (!i->message->IsPersistent() || i->message->GetFileBody() || !i->message->IsComplete()) {
+              break;
+            }
+          }
+
+          if (count != 0) {
+            handler_->GetStats().Add(ServerStats::COUNTER_WRITES);
+            len = static_cast<size_t>(WriteVector(segments, count));
+          }
+          else {
+            // Nothing left to write in the first message.
+            ConsumeOutgoing_(0);
+            continue;
+          }
+        }
+      }
+      catch (const sockets::ConnectionTerminatedError& e) {
+        GetLogger_().warnStream() << "Write failed with error: " << e.why();
+        Close(CLOSE_PEER);
+        return;
+      }
+      catch (const sockets::ConnectionTimeoutError& e) {
+        GetLogger_().warnStream() << "Write failed with error: " << e.why();
+        Close(CLOSE_TIMEOUT);
+        return;
       }
       catch (const sockets::SocketException& e) {
-        GetLogger_().warnStream() << "WriteStream failed with error: " << e.why();
-        Close();
-        break;
+        GetLogger_().warnStream() << "Write failed with error: " << e.why();
+        Close(CLOSE_ERROR);
+        return;
       }
       catch (const std::exception& e) {
-        GetLogger_().warnStream() << "WriteStream failed with error: " << e.what();
-        Close();
-        break;
+        GetLogger_().warnStream() << "Write failed with error: " << e.what();
+        Close(CLOSE_ERROR);
+        return;
       }
 
-      AfterEventWrite_(message);
-
-      if (!message->IsPersistent()) {
-        Close();
-        break;
+      // Socket buffer is full, the rest is written on the next write event.
+      if (len == 0) {
+        return;
       }
+
+      ConsumeOutgoing_(len);
     }
   }
 
@@ -152,7 +231,8 @@ namespace webserver {
 
     // Handle network errors.
     logger_.warn("Poll reports network error.");
-    Close();
+    const int error = Descriptor().GetError();
+    Close(error == ECONNRESET || error == EPIPE ? CLOSE_PEER : CLOSE_ERROR);
   }
 
 
@@ -161,18 +241,55 @@ namespace webserver {
       return false;
     }
 
+    const uint64_t now = RequestPhases::Now();
+    for (std::list<IncomingMessage::sptr>::const_iterator i = incoming_.begin(); i != incoming_.end(); ++i) {
+      (*i)->GetPhases().Set(PHASE_DEQUEUED, now);
+      if (RequestPhases* phases = FindPhases_((*i)->GetSequence())) {
+        phases->Set(PHASE_DEQUEUED, now);
+      }
+    }
+
     messages.swap(incoming_);
     return true;
   }
 
 
   void BaseConnection::SendMessage(const OutgoingMessage::sptr& message) {
+    uint64_t sequence = next_outgoing_;
+    while (reorder_.find(sequence) != reorder_.end()) {
+      ++sequence;
+    }
+
+    Emit_(message, sequence);
+  }
+
+
+  void BaseConnection::SendMessage(const OutgoingMessage::sptr& message, const IncomingMessage::sptr& request) {
+    Emit_(message, request->GetSequence());
+  }
+
+
+  void BaseConnection::DispatchIncoming(const IncomingMessage::sptr& incoming) {
     if (state_ != STATE_CONNECTED) {
       return;
     }
 
-    message->Serialize();
-    outgoing_.push_back(message);
+    incoming_.push_back(incoming);
+    MarkActivity_();
+  }
+
+
+  void BaseConnection::WakeWrite() {
+    handler_->PostWrite(weak_this_);
+  }
+
+
+  void BaseConnection::ResumeWrite() {
+    if (state_ != STATE_CONNECTED || !is_write_suspended_) {
+      return;
+    }
+
+    is_write_suspended_ = false;
     handler_->GetPoll()->InsertWrite(this);
   }
 
@@ -208,16 +325,22 @@ namespace webserver {
   }
 
 
-  void BaseConnection::Close() {
+  void BaseConnection::Close(const CloseReason reason) {
     if (state_ == STATE_CLOSING) {
       return;
     }
 
+    // Connection which was never initialized is not known to the poll.
+    const bool is_registered = state_ == STATE_CONNECTED;
     SetState(STATE_CLOSING);
+    if (accepted_ != 0) {
+      Status::Self()->GetConnectionStats().Closed(reason, next_incoming_, (RequestPhases::Now() - accepted_) / 1000000);
+    }
+
     BaseConnection::sptr c = weak_this_.lock();
     handler_->DeleteConnection(weak_this_);
 
-    if (handler_->GetPoll()) {
+    if (is_registered && handler_->GetPoll()) {
       handler_->GetPoll()->RemoveRead(this);
       handler_->GetPoll()->RemoveWrite(this);
       handler_->GetPoll()->RemoveError(this);
@@ -227,6 +350,32 @@ namespace webserver {
     if (Descriptor().IsValid()) {
       Descriptor().Close();
     }
+
+    for (std::list<Outgoing>::const_iterator i = outgoing_.begin(); i != outgoing_.end(); ++i) {
+      i->message->Abort();
+    }
+
+    for (ReorderBuffer::const_iterator i = reorder_.begin(); i != reorder_.end(); ++i) {
+      i->second->Abort();
+    }
+  }
+
+
+  void BaseConnection::Refuse(const OutgoingMessage::sptr& message) {
+    message->Serialize();
+
+    iovec segments[MAX_WRITE_SEGMENTS];
+    const size_t count = message->GetSegments(0, segments, MAX_WRITE_SEGMENTS);
+    try {
+      if (count != 0) {
+        WriteVector(segments, count);
+      }
+    }
+    catch (const std::exception& e) {
+      GetLogger_().warnStream() << "Refusal could not be written: " << e.what();
+    }
+
+    Close(CLOSE_REJECTED);
   }
 
 
@@ -235,16 +384,53 @@ namespace webserver {
   }
 
 
+  const BaseConnection::wptr& BaseConnection::GetWeakThis_() const {
+    return weak_this_;
+  }
+
+
   void BaseConnection::PushIncoming_(const IncomingMessage::sptr& incoming) {
+    NumberIncoming_(incoming);
     incoming_.push_back(incoming);
   }
 
 
+  void BaseConnection::NumberIncoming_(const IncomingMessage::sptr& incoming) {
+    RequestPhases& phases = incoming->GetPhases();
+    phases.Mark(PHASE_PARSED);
+    if (next_incoming_ == 0) {
+      phases.Set(PHASE_ACCEPTED, accepted_);
+    }
+
+    if (phases_.empty()) {
+      phases_first_ = next_incoming_;
+    }
+    phases_.push_back(phases);
+
+    incoming->SetSequence(next_incoming_++);
+  }
+
+
   void BaseConnection::MarkActivity_() {
     handler_->ActivityOn(weak_this_);
   }
 
 
+  void BaseConnection::SetCloseReason_(const CloseReason reason) {
+    close_reason_ = reason;
+  }
+
+
+  uint64_t BaseConnection::GetLastRead_() const {
+    return last_read_;
+  }
+
+
+  BaseConnection::ServerSPtr& BaseConnection::GetHandler_() {
+    return handler_;
+  }
+
+
   log4cpp::Category& BaseConnection::GetLogger_() {
     return logger_;
   }
@@ -283,8 +469,114 @@ namespace webserver {
   }
 
 
-  void BaseConnection::AfterEventWrite_(const OutgoingMessage::sptr& message) {
+  void BaseConnection::Emit_(OutgoingMessage::sptr message, const uint64_t sequence) {
+    if (state_ != STATE_CONNECTED) {
+      return;
+    }
+
+    RequestPhases* phases = sequence < next_incoming_ ? FindPhases_(sequence) : 0;
+    if (phases) {
+      phases->Mark(PHASE_HANDLED);
+    }
+
+    if (sequence < next_incoming_) {
+      BeforeSerialize_(message, sequence);
+    }
+
+    message->Serialize();
+    message->Attach(weak_this_);
+
+    if (phases) {
+      phases->Mark(PHASE_SERIALIZED);
+    }
+
+    // Nothing to answer, message is not a response.
+    if (sequence >= next_incoming_) {
+      const Outgoing outgoing = { message, NO_SEQUENCE };
+      outgoing_.push_back(outgoing);
+      handler_->GetPoll()->InsertWrite(this);
+      return;
+    }
+
+    if (sequence < next_outgoing_ || !reorder_.insert(std::make_pair(sequence, message)).second) {
+      logger_.warnStream() << "Request " << sequence << " is already answered, response is dropped.";
+      return;
+    }
+
+    const uint64_t first = next_outgoing_;
+    for (ReorderBuffer::iterator i = reorder_.begin(); i != reorder_.end() && i->first == next_outgoing_; reorder_.erase(i++)) {
+      const Outgoing outgoing = { i->second, i->first };
+      outgoing_.push_back(outgoing);
+      ++next_outgoing_;
+    }
+
+    if (next_outgoing_ != first) {
+      handler_->GetPoll()->InsertWrite(this);
+    }
+  }
+
+
+  void BaseConnection::ConsumeOutgoing_(size_t len) {
+    while (!outgoing_.empty()) {
+      const OutgoingMessage::sptr message = outgoing_.front().message;
+      const uint64_t sequence = outgoing_.front().sequence;
+      // Streamed message may grow meanwhile, so it is checked for completion first.
+      const bool is_complete = message->IsComplete();
+      const size_t left = message->GetLength() - outgoing_offset_;
+
+      if (len < left || !is_complete) {
+        outgoing_offset_ += len;
+
+        if (!message->Written(outgoing_offset_)) {
+          is_write_suspended_ = true;
+          handler_->GetPoll()->RemoveWrite(this);
+        }
+        return;
+      }
+
+      len -= left;
+      outgoing_offset_ = 0;
+      outgoing_.pop_front();
+
+      RequestPhases* phases = FindPhases_(sequence);
+      if (phases) {
+        phases->Mark(PHASE_WRITTEN);
+      }
+
+      AfterEventWrite_(message, sequence, phases);
+
+      while (sequence != NO_SEQUENCE && !phases_.empty() && phases_first_ <= sequence) {
+        phases_.pop_front();
+        ++phases_first_;
+      }
+
+      if (!message->IsPersistent()) {
+        Close(close_reason_);
+        return;
+      }
+    }
+  }
+
+
+  RequestPhases* BaseConnection::FindPhases_(const uint64_t sequence) {
+    if (sequence < phases_first_ || sequence - phases_first_ >= phases_.size()) {
+      return 0;
+    }
+
+    return &phases_[sequence - phases_first_];
+  }
+
+
+  void BaseConnection::BeforeSerialize_(OutgoingMessage::sptr& message, const uint64_t sequence) {
+    static_cast<void>(message);
+    static_cast<void>(sequence);
+  }
+
+
+  void BaseConnection::AfterEventWrite_(const OutgoingMessage::sptr& message, const uint64_t sequence, const RequestPhases* phases) {
     static_cast<void>(message);
+    static_cast<void>(sequence);
+    static_cast<void>(phases);
   }
 
 
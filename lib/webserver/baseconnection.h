@@ -5,10 +5,15 @@
 #ifndef WEBSERVER_BASE_CONNECTION_H__
 #define WEBSERVER_BASE_CONNECTION_H__
 
+#include "connectionstats.h"
 #include "message.h"
+#include "requestphases.h"
 #include <cstring/cstring.h>
+#include <deque>
+#include <inttypes.h>
 #include <log4cpp/Category.hh>
 #include <list>
+#include <map>
 #include <sockets/socket.h>
 #include <tr1/memory>
 
@@ -29,36 +34,97 @@ namespace webserver {
     void EventError();
 
     bool GetMessages(std::list<IncomingMessage::sptr>& messages);
+
+    // Responses are emitted in the order requests were received, each one as soon as all
+    // responses to earlier requests are emitted. Both methods must be called from the
+    // server's thread, use Server::PostMessage() from other threads.
+    //
+    // Answers the earliest request not answered yet, or is sent right away if there is none.
     void SendMessage(const OutgoingMessage::sptr& message);
+    // Answers given request.
+    void SendMessage(const OutgoingMessage::sptr& message, const IncomingMessage::sptr& request);
+
+    // Passes request numbered earlier to handlers. Must be called from the server's thread,
+    // use Server::PostIncoming() from other threads.
+    void DispatchIncoming(const IncomingMessage::sptr& incoming);
+
+    // Resumes writing of a streamed message which got more data. May be called from any thread.
+    void WakeWrite();
+    // Server's thread part of WakeWrite().
+    void ResumeWrite();
 
     void SetPersistence(const bool is_persistent);
     bool IsPersistent() const;
 
     void Initialize();
-    void Close();
+    void Close(const CloseReason reason = CLOSE_LOCAL);
+    // Writes message straight to the socket of connection which is not initialized, e.g.
+    // one over the connection limit, and closes it. Whatever the socket does not take at
+    // once is dropped.
+    void Refuse(const OutgoingMessage::sptr& message);
 
   protected:
+    // Sequence of messages which do not answer any request.
+    static const uint64_t NO_SEQUENCE = 0xffffffffffffffffULL;
+
     // Outgoing connection
     BaseConnection(const std::string& local, sockets::SocketAddress& remote, ServerSPtr& handler);
     // Incoming connection
     BaseConnection(const sockets::SocketFd& fd, ServerSPtr& handler);
 
     virtual void ProcessEventRead_(base::CString& buffer) = 0;
-    virtual void AfterEventWrite_(const OutgoingMessage::sptr& message);
+    // Called for responses before they are serialized, may replace the message.
+    virtual void BeforeSerialize_(OutgoingMessage::sptr& message, const uint64_t sequence);
+    // Called for every message written out, with sequence and phases of request it answers.
+    // Phases are null for messages which answer none.
+    virtual void AfterEventWrite_(const OutgoingMessage::sptr& message, const uint64_t sequence, const RequestPhases* phases);
     void SetWeakThis_(const wptr& weak_this);
+    const wptr& GetWeakThis_() const;
     void PushIncoming_(const IncomingMessage::sptr& incoming);
+    void NumberIncoming_(const IncomingMessage::sptr& incoming);
     void MarkActivity_();
+    // Reason the connection is closed for once a response which is not persistent is written.
+    void SetCloseReason_(const CloseReason reason);
+    // Time of the last read which brought data.
+    uint64_t GetLastRead_() const;
+    ServerSPtr& GetHandler_();
     log4cpp::Category& GetLogger_();
 
   private:
+    typedef std::map<uint64_t, OutgoingMessage::sptr> ReorderBuffer;
+
+    typedef struct {
+      OutgoingMessage::sptr message;
+      uint64_t sequence;
+    } Outgoing;
+
     void SetOptions_();
+    void Emit_(OutgoingMessage::sptr message, const uint64_t sequence);
+    // Drops len written bytes from the head of the outgoing queue.
+    void ConsumeOutgoing_(size_t len);
+    RequestPhases* FindPhases_(const uint64_t sequence);
 
     bool is_persistent_;
     const size_t buffer_length_;
     base::CString buffer_;
     ServerSPtr handler_;
     std::list<IncomingMessage::sptr> incoming_;
-    std::list<OutgoingMessage::sptr> outgoing_;
+    std::list<Outgoing> outgoing_;
+    // Bytes of the first outgoing message already written.
+    size_t outgoing_offset_;
+    // First outgoing message is a stream waiting for data.
+    bool is_write_suspended_;
+    // Responses waiting for responses to earlier requests.
+    ReorderBuffer reorder_;
+    uint64_t next_incoming_;
+    uint64_t next_outgoing_;
+    // Phases of requests numbered and not answered yet, the first one is of phases_first_.
+    std::deque<RequestPhases> phases_;
+    uint64_t phases_first_;
+    // Zero for outgoing connections.
+    uint64_t accepted_;
+    uint64_t last_read_;
+    CloseReason close_reason_;
     wptr weak_this_;
     log4cpp::Category& logger_;
   };
@@ -0,0 +1,47 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "blob.h"
+#include <cstring>
+
+
+namespace webserver {
+
+  Blob::Blob(char* data, const size_t len)
+  : data_(data)
+  , length_(len) { }
+
+
+  Blob::~Blob() {
+    delete[] data_;
+  }
+
+
+  Blob::sptr Blob::Create(const char* data, const size_t len) {
+    char* copy = new char[len];
+    ::memcpy(copy, data, len);
+    return Adopt(copy, len);
+  }
+
+
+  Blob::sptr Blob::Create(const std::string& data) {
+    return Create(data.data(), data.length());
+  }
+
+
+  Blob::sptr Blob::Adopt(char* data, const size_t len) {
+    return sptr(new Blob(data, len));
+  }
+
+
+  const char* Blob::Data() const {
+    return data_;
+  }
+
+
+  size_t Blob::Length() const {
+    return length_;
+  }
+
+} // namespace webserver
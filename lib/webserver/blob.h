@@ -0,0 +1,46 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_BLOB_H__
+#define WEBSERVER_BLOB_H__
+
+#include <base/prototype.h>
+#include <string>
+#include <tr1/memory>
+
+
+namespace webserver {
+
+  //
+  // Immutable reference-counted byte buffer.
+  //
+  // Blob may be attached to any number of outgoing messages at once, the bytes are
+  // sent straight from it and released when the last message is written.
+  //
+
+  class Blob : public base::NonCopyable {
+  public:
+    typedef std::tr1::shared_ptr<const Blob> sptr;
+
+    ~Blob();
+
+    // Copies data into a new blob.
+    static sptr Create(const char* data, const size_t len);
+    static sptr Create(const std::string& data);
+    // Takes ownership of a buffer allocated with new[].
+    static sptr Adopt(char* data, const size_t len);
+
+    const char* Data() const;
+    size_t Length() const;
+
+  private:
+    Blob(char* data, const size_t len);
+
+    char* data_;
+    const size_t length_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_BLOB_H__
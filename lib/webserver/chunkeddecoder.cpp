@@ -0,0 +1,143 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "chunkeddecoder.h"
+#include "exception.h"
+
+
+namespace webserver {
+
+  ChunkedDecoder::ChunkedDecoder()
+  : state_(STATE_SIZE)
+  , chunk_left_(0)
+  , size_digits_(0) { }
+
+
+  bool ChunkedDecoder::IsDone() const {
+    return state_ == STATE_DONE;
+  }
+
+
+  void ChunkedDecoder::Reset() {
+    state_ = STATE_SIZE;
+    chunk_left_ = 0;
+    size_digits_ = 0;
+  }
+
+
+  size_t ChunkedDecoder::Decode(const char* data, const size_t len, MessageBody& body) {
+    const char* p = data;
+    const char* const end = data + len;
+
+    while (p < end && state_ != STATE_DONE) {
+      switch (state_) {
+        case STATE_SIZE: {
+          int digit;
+          if (*p >= '0' && *p <= '9') {
+            digit = *p - '0';
+          }
+          else if (*p >= 'a' && *p <= 'f') {
+            digit = *p - 'a' + 10;
+          }
+          else if (*p >= 'A' && *p <= 'F') {
+            digit = *p - 'A' + 10;
+          }
+          else if (size_digits_ == 0) {
+            base_throw(DeserializationError, "Invalid chunk size");
+          }
+          else if (*p == '\r') {
+            state_ = STATE_SIZE_LF;
+            ++p;
+            break;
+          }
+          else if (*p == ';' || *p == ' ' || *p == '\t') {
+            state_ = STATE_EXTENSION;
+            ++p;
+            break;
+          }
+          else {
+            base_throw(DeserializationError, "Invalid chunk size");
+          }
+
+          if (chunk_left_ > (static_cast<size_t>(-1) >> 4)) {
+            base_throw(DeserializationError, "Chunk size is too big");
+          }
+
+          chunk_left_ = (chunk_left_ << 4) | static_cast<size_t>(digit);
+          ++size_digits_;
+          ++p;
+          break;
+        }
+
+        case STATE_EXTENSION:
+          // Chunk extensions are ignored.
+          if (*p == '\r') {
+            state_ = STATE_SIZE_LF;
+          }
+          ++p;
+          break;
+
+        case STATE_SIZE_LF:
+          if (*p++ != '\n') {
+            base_throw(DeserializationError, "Chunk size line is not terminated by CRLF");
+          }
+
+          size_digits_ = 0;
+          state_ = chunk_left_ == 0 ? STATE_TRAILER : STATE_DATA;
+          break;
+
+        case STATE_DATA: {
+          const size_t available = static_cast<size_t>(end - p);
+          const size_t n = available < chunk_left_ ? available : chunk_left_;
+          body.Append(p, n);
+          p += n;
+          chunk_left_ -= n;
+
+          if (chunk_left_ == 0) {
+            state_ = STATE_DATA_CR;
+          }
+          break;
+        }
+
+        case STATE_DATA_CR:
+          if (*p++ != '\r') {
+            base_throw(DeserializationError, "Chunk data is not terminated by CRLF");
+          }
+          state_ = STATE_DATA_LF;
+          break;
+
+        case STATE_DATA_LF:
+          if (*p++ != '\n') {
+            base_throw(DeserializationError, "Chunk data is not terminated by CRLF");
+          }
+          state_ = STATE_SIZE;
+          break;
+
+        case STATE_TRAILER:
+          // Trailer headers are skipped, empty line terminates the body.
+          state_ = *p++ == '\r' ? STATE_TRAILER_LF : STATE_TRAILER_LINE;
+          break;
+
+        case STATE_TRAILER_LINE:
+          if (*p++ == '\n') {
+            state_ = STATE_TRAILER;
+          }
+          break;
+
+        case STATE_TRAILER_LF:
+          if (*p++ != '\n') {
+            base_throw(DeserializationError, "Chunked body is not terminated by CRLF");
+          }
+          state_ = STATE_DONE;
+          break;
+
+        default:
+          break;
+      }
+    }
+
+    return static_cast<size_t>(p - data);
+  }
+
+} // namespace webserver
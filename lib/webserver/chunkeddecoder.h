@@ -0,0 +1,60 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_CHUNKED_DECODER_H__
+#define WEBSERVER_CHUNKED_DECODER_H__
+
+#include "messagebody.h"
+
+#include <base/prototype.h>
+
+
+namespace webserver {
+
+  //
+  // Incremental decoder for "Transfer-Encoding: chunked" bodies.
+  //
+  // Decoder keeps its state between calls, so body may be fed in pieces as they
+  // arrive from the socket, and each byte of input is looked at exactly once.
+  // Chunk data is appended to the output in one piece per chunk (or per input
+  // piece if chunk is split between reads).
+  //
+
+  class ChunkedDecoder : public base::NonCopyable {
+  public:
+    ChunkedDecoder();
+
+    // Decodes up to len bytes of data and appends chunks' payload to body.
+    // Returns amount of input bytes consumed; consumption stops right after the
+    // terminating empty line of the body.
+    //
+    // Throws:
+    //   DeserializationError, on erroneous data.
+    size_t Decode(const char* data, const size_t len, MessageBody& body);
+
+    bool IsDone() const;
+    void Reset();
+
+  private:
+    typedef enum {
+      STATE_SIZE,
+      STATE_EXTENSION,
+      STATE_SIZE_LF,
+      STATE_DATA,
+      STATE_DATA_CR,
+      STATE_DATA_LF,
+      STATE_TRAILER,
+      STATE_TRAILER_LINE,
+      STATE_TRAILER_LF,
+      STATE_DONE
+    } State;
+
+    State state_;
+    size_t chunk_left_;
+    unsigned int size_digits_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_CHUNKED_DECODER_H__
@@ -0,0 +1,138 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "commonheaders.h"
+#include <cstring>
+
+
+namespace webserver {
+
+  namespace {
+    const char* const WEEKDAYS[7] = { "Sun", "Mon", "Tue", "Wed", "Thu", "Fri", "Sat" };
+    const char* const MONTHS[12] = { "Jan", "Feb", "Mar", "Apr", "May", "Jun", "Jul", "Aug", "Sep", "Oct", "Nov", "Dec" };
+
+    char* FormatNumber(char* p, int value, const int digits) {
+      for (int i = digits - 1; i >= 0; --i) {
+        p[i] = static_cast<char>('0' + value % 10);
+        value /= 10;
+      }
+      return p + digits;
+    }
+  }
+
+
+  CommonHeaders::Slot CommonHeaders::slots_[CommonHeaders::SLOTS_COUNT];
+  tbb::atomic<size_t> CommonHeaders::current_;
+  tbb::spin_mutex CommonHeaders::mutex_;
+  std::string CommonHeaders::server_name_ = "libwebserver";
+  std::string CommonHeaders::headers_;
+  std::string CommonHeaders::static_ = "Server: libwebserver\r\n";
+
+
+  void CommonHeaders::Update(const time_t now) {
+    if (slots_[current_].second == now) {
+      return;
+    }
+
+    // Another server is already updating the line.
+    tbb::spin_mutex::scoped_lock lock;
+    if (!lock.try_acquire(mutex_)) {
+      return;
+    }
+
+    const size_t next = (current_ + 1) % SLOTS_COUNT;
+    Slot& slot = slots_[next];
+
+    ::memcpy(slot.line, "Date: ", 6);
+    FormatDate(now, slot.line + 6);
+    ::memcpy(slot.line + 6 + HTTP_DATE_LENGTH, "\r\n", 2);
+
+    slot.second = now;
+    current_ = next;
+  }
+
+
+  size_t CommonHeaders::FormatDate(const time_t t, char* buffer) {
+    tm parts;
+    ::gmtime_r(&t, &parts);
+
+    char* p = buffer;
+    ::memcpy(p, WEEKDAYS[parts.tm_wday], 3);
+    p += 3;
+    ::memcpy(p, ", ", 2);
+    p += 2;
+    p = FormatNumber(p, parts.tm_mday, 2);
+    *p++ = ' ';
+    ::memcpy(p, MONTHS[parts.tm_mon], 3);
+    p += 3;
+    *p++ = ' ';
+    p = FormatNumber(p, parts.tm_year + 1900, 4);
+    *p++ = ' ';
+    p = FormatNumber(p, parts.tm_hour, 2);
+    *p++ = ':';
+    p = FormatNumber(p, parts.tm_min, 2);
+    *p++ = ':';
+    p = FormatNumber(p, parts.tm_sec, 2);
+    ::memcpy(p, " GMT", 4);
+    p += 4;
+
+    return static_cast<size_t>(p - buffer);
+  }
+
+
+  const char* CommonHeaders::GetDate() {
+    // Servers were not started yet.
+    if (slots_[current_].second == 0) {
+      Update(::time(0));
+    }
+
+    return slots_[current_].line;
+  }
+
+
+  const std::string& CommonHeaders::GetStatic() {
+    return static_;
+  }
+
+
+  size_t CommonHeaders::Length() {
+    return DATE_LENGTH + static_.length();
+  }
+
+
+  size_t CommonHeaders::Copy(char* buffer) {
+    ::memcpy(buffer, GetDate(), DATE_LENGTH);
+    ::memcpy(buffer + DATE_LENGTH, static_.data(), static_.length());
+    return DATE_LENGTH + static_.length();
+  }
+
+
+  void CommonHeaders::SetServerName(const std::string& name) {
+    server_name_ = name;
+    Rebuild_();
+  }
+
+
+  void CommonHeaders::AddHeader(const std::string& key, const std::string& value) {
+    headers_.append(key);
+    headers_.append(": ");
+    headers_.append(value);
+    headers_.append("\r\n");
+    Rebuild_();
+  }
+
+
+  void CommonHeaders::Rebuild_() {
+    std::string block;
+    if (!server_name_.empty()) {
+      block.append("Server: ");
+      block.append(server_name_);
+      block.append("\r\n");
+    }
+
+    block.append(headers_);
+    static_.swap(block);
+  }
+
+} // namespace webserver
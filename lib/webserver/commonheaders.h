@@ -0,0 +1,67 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_COMMON_HEADERS_H__
+#define WEBSERVER_COMMON_HEADERS_H__
+
+#include <ctime>
+#include <string>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+
+namespace webserver {
+
+  //
+  // Header lines sent with every response: Date, Server and configured static headers.
+  //
+  // Date line is formatted once per second into the next one of a ring of slots, so a
+  // line being copied is not overwritten until a minute after it was replaced. Static
+  // part is set up before servers are started and does not change afterwards.
+  //
+
+  class CommonHeaders {
+  public:
+    // "Date: Sun, 06 Nov 1994 08:49:37 GMT\r\n"
+    static const size_t DATE_LENGTH = 37;
+    // "Sun, 06 Nov 1994 08:49:37 GMT"
+    static const size_t HTTP_DATE_LENGTH = 29;
+
+    // Writes time as HTTP-date into buffer, returns amount of bytes written.
+    static size_t FormatDate(const time_t t, char* buffer);
+
+    // Reformats Date line if the second has changed. Called by servers on every iteration.
+    static void Update(const time_t now);
+
+    static const char* GetDate();
+    static const std::string& GetStatic();
+    static size_t Length();
+    // Copies whole block into buffer and returns amount of bytes copied.
+    static size_t Copy(char* buffer);
+
+    // Empty name disables Server header.
+    static void SetServerName(const std::string& name);
+    static void AddHeader(const std::string& key, const std::string& value);
+
+  private:
+    static const size_t SLOTS_COUNT = 64;
+
+    typedef struct {
+      time_t second;
+      char line[DATE_LENGTH];
+    } Slot;
+
+    static void Rebuild_();
+
+    static Slot slots_[SLOTS_COUNT];
+    static tbb::atomic<size_t> current_;
+    static tbb::spin_mutex mutex_;
+    static std::string server_name_;
+    static std::string headers_;
+    static std::string static_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_COMMON_HEADERS_H__
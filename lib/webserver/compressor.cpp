@@ -0,0 +1,237 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "compressor.h"
+
+#include <cstdlib>
+#include <cstring>
+
+extern "C" {
+#include <pthread.h>
+#include <strings.h>
+#include <zlib.h>
+}
+
+
+namespace webserver {
+
+  namespace {
+    const char* const DEFAULT_CONTENT_TYPES[] = {
+      "text/",
+      "application/json",
+      "application/javascript",
+      "application/xml",
+      "image/svg+xml"
+    };
+
+    const char* const CODING_NAMES[] = { "identity", "gzip", "deflate" };
+
+    // Calling thread's deflate streams and levels they compress with, indexed by coding.
+    typedef struct {
+      z_stream streams[3];
+      int levels[3];
+      bool is_ready[3];
+    } Streams;
+
+    pthread_key_t streams_key;
+    pthread_once_t streams_once = PTHREAD_ONCE_INIT;
+
+
+    void DestroyStreams(void* p) {
+      Streams* streams = static_cast<Streams*>(p);
+      for (size_t i = 0; i < 3; ++i) {
+        if (streams->is_ready[i]) {
+          ::deflateEnd(&streams->streams[i]);
+        }
+      }
+      delete streams;
+    }
+
+
+    void CreateStreamsKey() {
+      ::pthread_key_create(&streams_key, DestroyStreams);
+    }
+
+
+    z_stream* GetStream(const Compressor::Coding coding, const int level) {
+      ::pthread_once(&streams_once, CreateStreamsKey);
+
+      Streams* streams = static_cast<Streams*>(::pthread_getspecific(streams_key));
+      if (!streams) {
+        streams = new Streams();
+        ::memset(streams, 0, sizeof(Streams));
+        ::pthread_setspecific(streams_key, streams);
+      }
+
+      z_stream* stream = &streams->streams[coding];
+      if (!streams->is_ready[coding]) {
+        // 16 added to window bits makes zlib write gzip wrapper.
+        const int window_bits = coding == Compressor::GZIP ? MAX_WBITS + 16 : MAX_WBITS;
+        if (::deflateInit2(stream, level, Z_DEFLATED, window_bits, 8, Z_DEFAULT_STRATEGY) != Z_OK) {
+          return 0;
+        }
+        streams->is_ready[coding] = true;
+        streams->levels[coding] = level;
+      }
+      else if (streams->levels[coding] != level) {
+        // Stream is reset after each response, so level is changed before any input.
+        if (::deflateParams(stream, level, Z_DEFAULT_STRATEGY) != Z_OK) {
+          return 0;
+        }
+        streams->levels[coding] = level;
+      }
+
+      return stream;
+    }
+
+
+    std::vector<std::string> DefaultContentTypes() {
+      return std::vector<std::string>(DEFAULT_CONTENT_TYPES, DEFAULT_CONTENT_TYPES + sizeof(DEFAULT_CONTENT_TYPES) / sizeof(DEFAULT_CONTENT_TYPES[0]));
+    }
+
+
+    void Trim(const char*& begin, const char*& end) {
+      while (begin < end && (*begin == ' ' || *begin == '\t')) {
+        ++begin;
+      }
+
+      while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
+      }
+    }
+  }
+
+
+  size_t Compressor::min_length_ = 1024;
+  int Compressor::level_ = 6;
+  std::vector<std::string> Compressor::content_types_ = DefaultContentTypes();
+
+
+  void Compressor::SetMinLength(const size_t length) {
+    min_length_ = length;
+  }
+
+
+  size_t Compressor::GetMinLength() {
+    return min_length_;
+  }
+
+
+  void Compressor::SetLevel(const int level) {
+    level_ = level;
+  }
+
+
+  void Compressor::AddContentType(const std::string& type) {
+    content_types_.push_back(type);
+  }
+
+
+  void Compressor::ClearContentTypes() {
+    content_types_.clear();
+  }
+
+
+  bool Compressor::IsCompressible(const std::string& content_type) {
+    for (std::vector<std::string>::const_iterator i = content_types_.begin(); i != content_types_.end(); ++i) {
+      if (content_type.size() >= i->size() && ::strncasecmp(content_type.c_str(), i->c_str(), i->size()) == 0) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  Compressor::Coding Compressor::Negotiate(const IncomingHttpMessage& request) {
+    const double gzip = GetQuality_(request, GZIP);
+    const double deflate = GetQuality_(request, DEFLATE);
+
+    if (gzip > 0 && gzip >= deflate) {
+      return GZIP;
+    }
+
+    return deflate > 0 ? DEFLATE : IDENTITY;
+  }
+
+
+  bool Compressor::Accepts(const IncomingHttpMessage& request, const Coding coding) {
+    return coding == IDENTITY || GetQuality_(request, coding) > 0;
+  }
+
+
+  const char* Compressor::GetName(const Coding coding) {
+    return CODING_NAMES[coding];
+  }
+
+
+  Blob::sptr Compressor::Compress(const Coding coding, const char* data, const size_t len) {
+    z_stream* stream = coding == IDENTITY ? 0 : GetStream(coding, level_);
+    if (!stream) {
+      return Blob::sptr();
+    }
+
+    const size_t bound = ::deflateBound(stream, static_cast<uLong>(len));
+    char* buffer = new char[bound];
+
+    stream->next_in = reinterpret_cast<Bytef*>(const_cast<char*>(data));
+    stream->avail_in = static_cast<uInt>(len);
+    stream->next_out = reinterpret_cast<Bytef*>(buffer);
+    stream->avail_out = static_cast<uInt>(bound);
+
+    const int result = ::deflate(stream, Z_FINISH);
+    const size_t length = bound - stream->avail_out;
+    ::deflateReset(stream);
+
+    if (result != Z_STREAM_END || length >= len) {
+      delete[] buffer;
+      return Blob::sptr();
+    }
+
+    return Blob::Adopt(buffer, length);
+  }
+
+
+  double Compressor::GetQuality_(const IncomingHttpMessage& request, const Coding coding) {
+    IncomingHttpMessage::HttpPair header;
+    if (!request.FindHeader("accept-encoding", header)) {
+      return 0;
+    }
+
+    const char* const name = CODING_NAMES[coding];
+    const size_t name_len = ::strlen(name);
+    double any = 0;
+
+    const char* p = header->value.c_str();
+    const char* const end = p + header->value.size();
+
+    while (p < end) {
+      const char* comma = static_cast<const char*>(::memchr(p, ',', end - p));
+      const char* coding_end = comma ? comma : end;
+      const char* params = static_cast<const char*>(::memchr(p, ';', coding_end - p));
+      const char* token = p;
+      const char* token_end = params ? params : coding_end;
+      Trim(token, token_end);
+
+      // Coding is refused by zero quality only.
+      const char* q = params ? static_cast<const char*>(::memchr(params, '=', coding_end - params)) : 0;
+      const double quality = q ? ::strtod(q + 1, 0) : 1;
+
+      const size_t len = token_end - token;
+      if ((len == name_len && ::strncasecmp(token, name, len) == 0) ||
+          (coding == GZIP && len == 6 && ::strncasecmp(token, "x-gzip", 6) == 0)) {
+        return quality;
+      }
+
+      if (len == 1 && *token == '*') {
+        any = quality;
+      }
+
+      p = comma ? comma + 1 : end;
+    }
+
+    return any;
+  }
+
+} // namespace webserver
@@ -0,0 +1,66 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_COMPRESSOR_H__
+#define WEBSERVER_COMPRESSOR_H__
+
+#include "blob.h"
+#include "incominghttpmessage.h"
+
+#include <string>
+#include <vector>
+
+
+namespace webserver {
+
+  //
+  // Response body compression negotiated with Accept-Encoding.
+  //
+  // Each thread compresses with its own deflate streams, created on first use and reset
+  // between responses, so no state is allocated per response. Output is deflated straight
+  // into the buffer which is sent as the body.
+  //
+  // Settings are changed before servers are started.
+  //
+
+  class Compressor {
+  public:
+    typedef enum {
+      IDENTITY,
+      GZIP,
+      DEFLATE
+    } Coding;
+
+    // Bodies shorter than this are sent as they are, 1024 bytes by default.
+    static void SetMinLength(const size_t length);
+    static size_t GetMinLength();
+    // zlib compression level, 6 by default. Streams created before take it with their next
+    // response.
+    static void SetLevel(const int level);
+    // Media types which are compressed, matched as prefixes: "text/" allows all text types.
+    // Text, JSON, JavaScript, XML and SVG are allowed by default.
+    static void AddContentType(const std::string& type);
+    static void ClearContentTypes();
+
+    static bool IsCompressible(const std::string& content_type);
+    // Coding preferred by the client, gzip wins ties.
+    static Coding Negotiate(const IncomingHttpMessage& request);
+    static bool Accepts(const IncomingHttpMessage& request, const Coding coding);
+    static const char* GetName(const Coding coding);
+
+    // Compresses data with the calling thread's stream. Returns empty pointer if result would
+    // not be smaller than data.
+    static Blob::sptr Compress(const Coding coding, const char* data, const size_t len);
+
+  private:
+    static double GetQuality_(const IncomingHttpMessage& request, const Coding coding);
+
+    static size_t min_length_;
+    static int level_;
+    static std::vector<std::string> content_types_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_COMPRESSOR_H__
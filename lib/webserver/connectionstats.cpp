@@ -0,0 +1,126 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "connectionstats.h"
+
+#include <cstring>
+
+
+namespace webserver {
+
+  ConnectionStats::ConnectionStats()
+  : ticked_accepted_(0)
+  , accept_rate_(0)
+  , seconds_(0) {
+    accepted_ = 0;
+    requests_ = 0;
+    reused_requests_ = 0;
+
+    for (size_t i = 0; i < CLOSE_REASONS_COUNT; ++i) {
+      closed_[i] = 0;
+      ticked_closed_[i] = 0;
+      close_rate_[i] = 0;
+    }
+
+    ::memset(&requests_per_connection_, 0, sizeof(requests_per_connection_));
+    ::memset(&age_, 0, sizeof(age_));
+  }
+
+
+  void ConnectionStats::Accepted() {
+    ++accepted_;
+  }
+
+
+  void ConnectionStats::Closed(const CloseReason reason, const uint64_t requests, const uint64_t age) {
+    ++closed_[reason];
+    // Refused and idle connections would drown the distributions in zeros.
+    if (reason == CLOSE_REJECTED || requests == 0) {
+      return;
+    }
+
+    requests_ += requests;
+    if (requests > 1) {
+      reused_requests_ += requests - 1;
+    }
+
+    requests_recorder_.Record(requests);
+    age_recorder_.Record(age);
+  }
+
+
+  void ConnectionStats::Tick() {
+    const uint64_t accepted = accepted_;
+    accept_rates_.Push(accepted - ticked_accepted_);
+    ticked_accepted_ = accepted;
+    accept_rate_ = accept_rates_.GetAverage(SlidingWindows::WINDOW_1);
+
+    for (size_t i = 0; i < CLOSE_REASONS_COUNT; ++i) {
+      const uint64_t closed = closed_[i];
+      close_rates_[i].Push(closed - ticked_closed_[i]);
+      ticked_closed_[i] = closed;
+      close_rate_[i] = close_rates_[i].GetAverage(SlidingWindows::WINDOW_1);
+    }
+
+    requests_recorder_.Drain(requests_minute_);
+    age_recorder_.Drain(age_minute_);
+
+    if (++seconds_ < 60) {
+      return;
+    }
+    seconds_ = 0;
+
+    const LatencyPercentiles requests_per_connection = requests_minute_.Summarize();
+    const LatencyPercentiles age = age_minute_.Summarize();
+    requests_minute_.Clear();
+    age_minute_.Clear();
+
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    requests_per_connection_ = requests_per_connection;
+    age_ = age;
+  }
+
+
+  uint64_t ConnectionStats::GetAccepted() const {
+    return accepted_;
+  }
+
+
+  uint64_t ConnectionStats::GetClosed(const CloseReason reason) const {
+    return closed_[reason];
+  }
+
+
+  unsigned int ConnectionStats::AcceptRate() const {
+    return accept_rate_;
+  }
+
+
+  unsigned int ConnectionStats::CloseRate(const CloseReason reason) const {
+    return close_rate_[reason];
+  }
+
+
+  uint64_t ConnectionStats::GetRequests() const {
+    return requests_;
+  }
+
+
+  uint64_t ConnectionStats::GetReusedRequests() const {
+    return reused_requests_;
+  }
+
+
+  LatencyPercentiles ConnectionStats::GetRequestsPerConnection() const {
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    return requests_per_connection_;
+  }
+
+
+  LatencyPercentiles ConnectionStats::GetAge() const {
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    return age_;
+  }
+
+} // namespace webserver
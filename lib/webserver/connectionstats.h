@@ -0,0 +1,109 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_CONNECTION_STATS_H__
+#define WEBSERVER_CONNECTION_STATS_H__
+
+#include "latencyhistogram.h"
+#include "slidingwindows.h"
+
+#include <base/prototype.h>
+#include <cstddef>
+#include <inttypes.h>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+
+namespace webserver {
+
+  typedef enum {
+    // Closed by this side, e.g. by handler or on shutdown.
+    CLOSE_LOCAL,
+    // Peer closed or reset connection.
+    CLOSE_PEER,
+    // Socket or poll failed otherwise.
+    CLOSE_ERROR,
+    CLOSE_TIMEOUT,
+    // Response was not persistent, as Connection: close asked.
+    CLOSE_NOT_PERSISTENT,
+    // Request could not be parsed or was refused, or its header did not fit the buffer.
+    CLOSE_PARSE_ERROR,
+    // Connection was over the limit and rejected with 503.
+    CLOSE_REJECTED,
+    CLOSE_REASONS_COUNT
+  } CloseReason;
+
+  const char* const CLOSE_REASON_NAMES[CLOSE_REASONS_COUNT] = {
+    "local",
+    "peer",
+    "error",
+    "timeout",
+    "not_persistent",
+    "parse_error",
+    "rejected"
+  };
+
+
+  //
+  // Lifecycle of incoming connections: accepts and closes by reason, requests served on
+  // every connection and its age once closed.
+  //
+  // Connections are counted from any thread without locks. Once a second Tick() turns
+  // counts into rates, once a minute distributions are summarized.
+  //
+
+  class ConnectionStats : public base::NonCopyable {
+  public:
+    ConnectionStats();
+
+    void Accepted();
+    // Requests counts requests received on connection, age is in milliseconds. Connections
+    // rejected or closed without a request are counted by reason only.
+    void Closed(const CloseReason reason, const uint64_t requests, const uint64_t age);
+    // Called once a second by a single thread.
+    void Tick();
+
+    uint64_t GetAccepted() const;
+    uint64_t GetClosed(const CloseReason reason) const;
+    // Per second, averaged over the last minute.
+    unsigned int AcceptRate() const;
+    unsigned int CloseRate(const CloseReason reason) const;
+
+    // Requests received on closed connections and those of them which came on a connection
+    // kept alive after an earlier request.
+    uint64_t GetRequests() const;
+    uint64_t GetReusedRequests() const;
+
+    // Of connections closed after a request during the last complete minute.
+    LatencyPercentiles GetRequestsPerConnection() const;
+    LatencyPercentiles GetAge() const;
+
+  private:
+    tbb::atomic<uint64_t> accepted_;
+    tbb::atomic<uint64_t> closed_[CLOSE_REASONS_COUNT];
+    tbb::atomic<uint64_t> requests_;
+    tbb::atomic<uint64_t> reused_requests_;
+
+    // Counts as of the previous tick.
+    uint64_t ticked_accepted_;
+    uint64_t ticked_closed_[CLOSE_REASONS_COUNT];
+    SlidingWindows accept_rates_;
+    SlidingWindows close_rates_[CLOSE_REASONS_COUNT];
+    unsigned int accept_rate_;
+    unsigned int close_rate_[CLOSE_REASONS_COUNT];
+
+    LatencyRecorder requests_recorder_;
+    LatencyRecorder age_recorder_;
+    LatencyHistogram requests_minute_;
+    LatencyHistogram age_minute_;
+    size_t seconds_;
+
+    mutable tbb::spin_mutex percentiles_mutex_;
+    LatencyPercentiles requests_per_connection_;
+    LatencyPercentiles age_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_CONNECTION_STATS_H__
@@ -9,6 +9,12 @@ namespace webserver {
   DeserializationError::DeserializationError(const char* file, const size_t line, const std::string& init_why)
   : BaseReasonedException("Deserialization failed", file, line, init_why) { }
 
+  InvalidRequestError::InvalidRequestError(const char* file, const size_t line, const std::string& init_why)
+  : BaseReasonedException("Invalid request", file, line, init_why) { }
+
+  BodyTooLargeError::BodyTooLargeError(const char* file, const size_t line, const std::string& init_why)
+  : BaseReasonedException("Request body too large", file, line, init_why) { }
+
   TooManyConnectionsError::TooManyConnectionsError(const char* file, const size_t line, const std::string& init_why)
   : BaseReasonedException("Too many connections", file, line, init_why) { }
 
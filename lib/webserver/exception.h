@@ -14,6 +14,17 @@ namespace webserver {
     DeserializationError(const char* file, const size_t line, const std::string& init_why = "");
   };
 
+  // Request is invalid for sure, unlike the incomplete one deserialization may fail on.
+  class InvalidRequestError : public BaseReasonedException {
+  public:
+    InvalidRequestError(const char* file, const size_t line, const std::string& init_why = "");
+  };
+
+  class BodyTooLargeError : public BaseReasonedException {
+  public:
+    BodyTooLargeError(const char* file, const size_t line, const std::string& init_why = "");
+  };
+
   class TooManyConnectionsError : public BaseReasonedException {
   public:
     TooManyConnectionsError(const char* file, const size_t line, const std::string& init_why = "");
@@ -0,0 +1,117 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "filebody.h"
+
+#include <base/c_format.h>
+#include <base/exception.h>
+#include <cerrno>
+#include <cstring>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+
+namespace webserver {
+
+  FileBody::FileBody(const int fd, const off_t offset, const size_t length, const bool is_owned)
+  : fd_(fd)
+  , offset_(offset)
+  , length_(length)
+  , is_owned_(is_owned)
+  , map_(0)
+  , map_length_(0) {
+    data_ = 0;
+  }
+
+
+  FileBody::~FileBody() {
+    if (map_) {
+      ::munmap(map_, map_length_);
+    }
+
+    if (is_owned_) {
+      ::close(fd_);
+    }
+  }
+
+
+  FileBody::sptr FileBody::Open(const std::string& path) {
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      base_throw(IOException, c_format("Could not open %s: %s", path.c_str(), ::strerror(errno)));
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0) {
+      const int error = errno;
+      ::close(fd);
+      base_throw(IOException, c_format("Could not stat %s: %s", path.c_str(), ::strerror(error)));
+    }
+
+    return sptr(new FileBody(fd, 0, static_cast<size_t>(st.st_size), true));
+  }
+
+
+  int FileBody::GetDescriptor() const {
+    return fd_;
+  }
+
+
+  off_t FileBody::GetOffset() const {
+    return offset_;
+  }
+
+
+  size_t FileBody::Length() const {
+    return length_;
+  }
+
+
+  size_t FileBody::Send(sockets::Socket& socket, const size_t offset) const {
+    if (offset >= length_) {
+      return 0;
+    }
+
+    if (!data_) {
+      const ssize_t r = socket.SendFile(fd_, offset_ + static_cast<off_t>(offset), length_ - offset);
+      if (r >= 0) {
+        return static_cast<size_t>(r);
+      }
+    }
+
+    iovec segment;
+    segment.iov_base = const_cast<char*>(Map_() + offset);
+    segment.iov_len = length_ - offset;
+    return static_cast<size_t>(socket.WriteVector(&segment, 1));
+  }
+
+
+  const char* FileBody::Map_() const {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+
+    if (!data_) {
+      // Mapping has to start at page boundary.
+      const off_t page = static_cast<off_t>(::sysconf(_SC_PAGESIZE));
+      const off_t start = offset_ - offset_ % page;
+      const size_t shift = static_cast<size_t>(offset_ - start);
+
+      void* map = ::mmap(0, length_ + shift, PROT_READ, MAP_SHARED, fd_, start);
+      if (map == MAP_FAILED) {
+        base_throw(IOException, c_format("Could not map file body: %s", ::strerror(errno)));
+      }
+
+      map_ = map;
+      map_length_ = length_ + shift;
+      data_ = static_cast<const char*>(map) + shift;
+    }
+
+    return data_;
+  }
+
+} // namespace webserver
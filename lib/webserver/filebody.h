@@ -0,0 +1,72 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_FILE_BODY_H__
+#define WEBSERVER_FILE_BODY_H__
+
+#include <base/prototype.h>
+#include <sockets/socket.h>
+#include <string>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <tr1/memory>
+
+extern "C" {
+#include <sys/types.h>
+}
+
+
+namespace webserver {
+
+  //
+  // Range of a file sent as message body.
+  //
+  // File data is passed from page cache to the socket with sendfile(), never copied into
+  // the process. Where sendfile() is not available for the file, the range is mapped
+  // into memory once and written from there.
+  //
+
+  class FileBody : public base::NonCopyable {
+  public:
+    typedef std::tr1::shared_ptr<FileBody> sptr;
+
+    // Descriptor is closed on destruction if is_owned is set.
+    FileBody(const int fd, const off_t offset, const size_t length, const bool is_owned);
+    ~FileBody();
+
+    // Whole file.
+    //
+    // Throws:
+    //   IOException, if file cannot be opened.
+    static sptr Open(const std::string& path);
+
+    int GetDescriptor() const;
+    off_t GetOffset() const;
+    size_t Length() const;
+
+    // Sends range data starting from offset into it and returns amount of bytes sent, zero
+    // if socket is not ready.
+    //
+    // Throws:
+    //   sockets::SocketException, on socket errors.
+    //   IOException, if file can neither be sent nor mapped.
+    size_t Send(sockets::Socket& socket, const size_t offset) const;
+
+  private:
+    const char* Map_() const;
+
+    const int fd_;
+    const off_t offset_;
+    const size_t length_;
+    const bool is_owned_;
+
+    mutable tbb::spin_mutex mutex_;
+    mutable void* map_;
+    mutable size_t map_length_;
+    mutable tbb::atomic<const char*> data_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_FILE_BODY_H__
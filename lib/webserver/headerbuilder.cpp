@@ -0,0 +1,174 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "headerbuilder.h"
+
+#include <cstring>
+
+extern "C" {
+#include <strings.h>
+}
+
+
+namespace webserver {
+
+  namespace {
+    // Two digits of every number below 100.
+    const char DIGIT_PAIRS[] =
+      "00010203040506070809"
+      "10111213141516171819"
+      "20212223242526272829"
+      "30313233343536373839"
+      "40414243444546474849"
+      "50515253545556575859"
+      "60616263646566676869"
+      "70717273747576777879"
+      "80818283848586878889"
+      "90919293949596979899";
+  }
+
+
+  size_t FormatDecimal(uint64_t value, char* buffer) {
+    char digits[MAX_DECIMAL_LENGTH];
+    char* p = digits + MAX_DECIMAL_LENGTH;
+
+    while (value >= 100) {
+      const size_t pair = static_cast<size_t>(value % 100) * 2;
+      value /= 100;
+      *--p = DIGIT_PAIRS[pair + 1];
+      *--p = DIGIT_PAIRS[pair];
+    }
+
+    if (value >= 10) {
+      const size_t pair = static_cast<size_t>(value) * 2;
+      *--p = DIGIT_PAIRS[pair + 1];
+      *--p = DIGIT_PAIRS[pair];
+    }
+    else {
+      *--p = static_cast<char>('0' + value);
+    }
+
+    const size_t len = static_cast<size_t>(digits + MAX_DECIMAL_LENGTH - p);
+    ::memcpy(buffer, p, len);
+    return len;
+  }
+
+
+  HeaderBuilder::HeaderBuilder()
+  : data_(arena_)
+  , length_(0)
+  , capacity_(ARENA_LENGTH) { }
+
+
+  HeaderBuilder::~HeaderBuilder() {
+    if (data_ != arena_) {
+      delete[] data_;
+    }
+  }
+
+
+  void HeaderBuilder::Append(const char* data, const size_t len) {
+    if (length_ + len > capacity_) {
+      Grow_(length_ + len);
+    }
+
+    ::memcpy(data_ + length_, data, len);
+    length_ += len;
+  }
+
+
+  void HeaderBuilder::Append(const char* str) {
+    Append(str, ::strlen(str));
+  }
+
+
+  void HeaderBuilder::Append(const std::string& str) {
+    Append(str.data(), str.length());
+  }
+
+
+  void HeaderBuilder::AppendLine(const char* key, const char* value) {
+    const size_t key_len = ::strlen(key);
+    const size_t value_len = ::strlen(value);
+
+    if (length_ + key_len + value_len + 4 > capacity_) {
+      Grow_(length_ + key_len + value_len + 4);
+    }
+
+    char* p = data_ + length_;
+    ::memcpy(p, key, key_len);
+    p += key_len;
+    *p++ = ':';
+    *p++ = ' ';
+    ::memcpy(p, value, value_len);
+    p += value_len;
+    *p++ = '\r';
+    *p++ = '\n';
+    length_ = p - data_;
+  }
+
+
+  void HeaderBuilder::AppendNumber(const uint64_t value) {
+    if (length_ + MAX_DECIMAL_LENGTH > capacity_) {
+      Grow_(length_ + MAX_DECIMAL_LENGTH);
+    }
+
+    length_ += FormatDecimal(value, data_ + length_);
+  }
+
+
+  const char* HeaderBuilder::Data() const {
+    return data_;
+  }
+
+
+  size_t HeaderBuilder::Length() const {
+    return length_;
+  }
+
+
+  bool HeaderBuilder::Find(const char* key, std::string& value) const {
+    const size_t key_len = ::strlen(key);
+    const char* line = data_;
+    const char* const end = data_ + length_;
+
+    while (line < end) {
+      const char* line_end = static_cast<const char*>(::memchr(line, '\n', end - line));
+      line_end = line_end ? line_end - 1 : end;
+
+      if (static_cast<size_t>(line_end - line) > key_len && line[key_len] == ':' &&
+          ::strncasecmp(line, key, key_len) == 0) {
+        const char* begin = line + key_len + 1;
+        while (begin < line_end && *begin == ' ') {
+          ++begin;
+        }
+        value.assign(begin, line_end - begin);
+        return true;
+      }
+
+      line = line_end + 2;
+    }
+
+    return false;
+  }
+
+
+  void HeaderBuilder::Grow_(const size_t needed) {
+    size_t capacity = capacity_ * 2;
+    while (capacity < needed) {
+      capacity *= 2;
+    }
+
+    char* data = new char[capacity];
+    ::memcpy(data, data_, length_);
+
+    if (data_ != arena_) {
+      delete[] data_;
+    }
+
+    data_ = data;
+    capacity_ = capacity;
+  }
+
+} // namespace webserver
@@ -0,0 +1,63 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_HEADER_BUILDER_H__
+#define WEBSERVER_HEADER_BUILDER_H__
+
+#include <base/prototype.h>
+#include <cstddef>
+#include <inttypes.h>
+#include <string>
+
+
+namespace webserver {
+
+  // Longest decimal representation of uint64_t.
+  static const size_t MAX_DECIMAL_LENGTH = 20;
+
+  // Writes value in decimal into buffer of at least MAX_DECIMAL_LENGTH bytes, returns
+  // amount of bytes written. Buffer is not terminated.
+  size_t FormatDecimal(uint64_t value, char* buffer);
+
+
+  //
+  // Header lines of an outgoing message.
+  //
+  // Lines are kept in an arena inside the message, so typical headers are collected without
+  // a single allocation; arena spills to the heap only when it is outgrown. Header stays
+  // with its message, which may be built on one thread and serialized on another.
+  //
+
+  class HeaderBuilder : public base::NonCopyable {
+  public:
+    HeaderBuilder();
+    ~HeaderBuilder();
+
+    void Append(const char* data, const size_t len);
+    void Append(const char* str);
+    void Append(const std::string& str);
+    // Appends "key: value\r\n".
+    void AppendLine(const char* key, const char* value);
+    void AppendNumber(const uint64_t value);
+
+    const char* Data() const;
+    size_t Length() const;
+    // Copies value of the first line with given key into value, key is compared
+    // case-insensitively.
+    bool Find(const char* key, std::string& value) const;
+
+  private:
+    static const size_t ARENA_LENGTH = 256;
+
+    void Grow_(const size_t needed);
+
+    char arena_[ARENA_LENGTH];
+    char* data_;
+    size_t length_;
+    size_t capacity_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_HEADER_BUILDER_H__
@@ -7,16 +7,34 @@
 #include "incominghttpmessage.h"
 #include "status.h"
 
+#include <ctime>
+
 namespace webserver {
 
   HttpConnection::HttpConnection(const std::string& local, sockets::SocketAddress& remote, Server::sptr& handler)
   : BaseConnection(local, remote, handler)
-  , buffer_has_bad_data_(false) { }
+  , buffer_has_bad_data_(false)
+  , is_rejected_(false)
+  , pending_length_(0)
+  , pending_since_(0)
+  , sampled_sequence_(NO_SEQUENCE) { }
 
 
   HttpConnection::HttpConnection(const sockets::SocketFd& fd, Server::sptr& handler)
   : BaseConnection(fd, handler)
-  , buffer_has_bad_data_(false) { }
+  , buffer_has_bad_data_(false)
+  , is_rejected_(false)
+  , pending_length_(0)
+  , pending_since_(0)
+  , sampled_sequence_(NO_SEQUENCE) { }
+
+
+  HttpConnection::~HttpConnection() {
+    // Requests waiting for responses to requests of this connection are not left hanging.
+    for (std::map<uint64_t, std::string>::const_iterator i = flights_.begin(); i != flights_.end(); ++i) {
+      GetHandler_()->GetRequestCoalescer()->Abandon(i->second);
+    }
+  }
 
 
   HttpConnection::sptr HttpConnection::Create(const std::string& local, const std::string& remote, const uint16_t port,
@@ -34,13 +52,14 @@ namespace webserver {
   HttpConnection::sptr HttpConnection::Create(const sockets::SocketFd& fd, Server::sptr& handler) {
     HttpConnection::sptr c = HttpConnection::sptr(new HttpConnection(fd, handler));
     c->SetWeakThis_(c);
+    Status::Self()->GetConnectionStats().Accepted();
 
     try {
       handler->NewConnection(c);
       c->Initialize();
     }
     catch (const TooManyConnectionsError& e) {
-      c->SendMessage(OutgoingHttpMessage::TooManyConnections());
+      c->Refuse(OutgoingHttpMessage::TooManyConnections());
     }
 
     return c;
@@ -48,16 +67,42 @@ namespace webserver {
 
 
   void HttpConnection::ProcessEventRead_(base::CString& buffer) {
-    IncomingHttpMessage::sptr message;
+    IncomingHttpMessage::sptr& message = pending_;
     size_t eof = 0;
 
+    if (is_rejected_) {
+      buffer.Clear();
+      return;
+    }
+
     try {
-      while (IncomingHttpMessage::Deserialize(message, buffer, eof)) {
-        PushIncoming_(message);
-        buffer.Erase(0, eof);
+      while (true) {
+        if (pending_since_ == 0 && buffer.Length() != 0) {
+          pending_since_ = GetLastRead_();
+        }
+
+        const bool is_complete = IncomingHttpMessage::Deserialize(message, buffer, eof, GetHandler_()->GetBodySinkFactory().get(),
+                                                                  GetHandler_()->GetMaxBodyLength());
+
+        // Once header is parsed, consumed data is released right away, so large bodies never
+        // pile up in the buffer.
+        if (message && message->IsHeaderParsed() && eof != 0) {
+          buffer.Erase(0, eof);
+          Status::Self()->IncomingRequest(eof);
+          pending_length_ += eof;
+        }
+
+        if (!is_complete) {
+          break;
+        }
+
         SetPersistence(message->IsPersistent());
-        MarkActivity_();
-        Status::Self()->IncomingRequest(eof);
+        message->GetPhases().Set(PHASE_FIRST_BYTE, pending_since_);
+        Dispatch_(message);
+
+        message.reset();
+        pending_length_ = 0;
+        pending_since_ = 0;
         eof = 0;
       }
 
@@ -65,24 +110,181 @@ namespace webserver {
     }
     catch (const DeserializationError& e) {
       if (buffer_has_bad_data_) {
+        // Bad request takes its place in line, after responses to requests received before.
+        NumberIncoming_(message);
+        SetCloseReason_(CLOSE_PARSE_ERROR);
+
         IncomingHttpMessage::HttpPair id;
         if (message->GetRequestId(id)) {
-          SendMessage(OutgoingHttpMessage::BadRequest(id->value));
+          SendMessage(OutgoingHttpMessage::BadRequest(id->value), message);
         }
         else {
-          SendMessage(OutgoingHttpMessage::BadRequest());
+          SendMessage(OutgoingHttpMessage::BadRequest(), message);
         }
 
         GetLogger_().warnStream() << "HTTP deserialization failed: " + e.why() + "\n<buffer>" + buffer.Str() + "</buffer>";
       } else {
         buffer_has_bad_data_ = true;
       }
+
+      message.reset();
+      pending_length_ = 0;
+      pending_since_ = 0;
+    }
+    catch (const InvalidRequestError& e) {
+      GetLogger_().warnStream() << "HTTP request rejected: " << e.why();
+
+      IncomingHttpMessage::HttpPair id;
+      Reject_(message, message->GetRequestId(id) ? OutgoingHttpMessage::BadRequest(id->value) : OutgoingHttpMessage::BadRequest(), buffer);
+    }
+    catch (const BodyTooLargeError& e) {
+      GetLogger_().warnStream() << "HTTP request rejected: " << e.why();
+      Reject_(message, OutgoingHttpMessage::EntityTooLarge(), buffer);
+    }
+    catch (const IOException& e) {
+      // Body could not be spilled, e.g. disk is full: there is no telling how much of it
+      // was stored, so the connection is given up.
+      GetLogger_().warnStream() << "HTTP request body failed: " << e.why();
+      message.reset();
+      Close(CLOSE_ERROR);
     }
   }
 
 
-  void HttpConnection::AfterEventWrite_(const OutgoingMessage::sptr& message) {
-    Status::Self()->ServedRequest(std::tr1::dynamic_pointer_cast<OutgoingHttpMessage>(message));
+  void HttpConnection::Reject_(const IncomingHttpMessage::sptr& message, const OutgoingHttpMessage::sptr& response, base::CString& buffer) {
+    NumberIncoming_(message);
+    SetCloseReason_(CLOSE_PARSE_ERROR);
+    SendMessage(response, message);
+
+    buffer.Clear();
+    is_rejected_ = true;
+    pending_.reset();
+    pending_length_ = 0;
+    pending_since_ = 0;
+  }
+
+
+  void HttpConnection::Dispatch_(const IncomingHttpMessage::sptr& request) {
+    NumberIncoming_(request);
+    if (request->GetMethod() == HEAD) {
+      head_requests_.insert(request->GetSequence());
+    }
+    if (request->IsHttp10()) {
+      http10_requests_.insert(request->GetSequence());
+    }
+
+    const size_t route = Status::Self()->FindRoute(request->GetUri());
+    if (route != WebserverStatus::NO_ROUTE) {
+      Status::Self()->RoutedRequest(route, pending_length_);
+      routes_[request->GetSequence()] = route;
+    }
+
+    const SlowRequestLog::sptr& slow = GetHandler_()->GetSlowRequestLog();
+    // Request sampled while another one of the connection is followed is let go.
+    if (slow && slow->Sample() && sampled_sequence_ == NO_SEQUENCE) {
+      slow->Capture(*request, sampled_);
+      sampled_sequence_ = request->GetSequence();
+    }
+
+    const MetricsExporter::sptr& metrics = GetHandler_()->GetMetricsExporter();
+    if (metrics && metrics->IsScrape(*request)) {
+      SendMessage(metrics->Serve(request, *GetHandler_()), request);
+      return;
+    }
+
+    const ResponseCache::sptr& cache = GetHandler_()->GetResponseCache();
+    std::string key;
+    unsigned int ttl = 0;
+
+    if (cache && cache->GetKey(*request, key, ttl)) {
+      if (OutgoingHttpMessage::sptr cached = cache->Lookup(key, ::time(0))) {
+        SendMessage(OutgoingHttpMessage::Reuse(cached, request->IsPersistent(), &request->GetTimer()), request);
+        return;
+      }
+
+      cache_keys_[request->GetSequence()] = std::make_pair(key, ttl);
+    }
+
+    const RequestCoalescer::sptr& coalescer = GetHandler_()->GetRequestCoalescer();
+    std::string flight;
+
+    if (coalescer && coalescer->GetKey(*request, flight)) {
+      switch (coalescer->Join(flight, GetWeakThis_(), GetHandler_(), request)) {
+        case RequestCoalescer::ROLE_WAITER:
+          return;
+        case RequestCoalescer::ROLE_LEADER:
+          flights_[request->GetSequence()] = flight;
+          break;
+        default:
+          break;
+      }
+    }
+
+    DispatchIncoming(request);
+  }
+
+
+  void HttpConnection::BeforeSerialize_(OutgoingMessage::sptr& message, const uint64_t sequence) {
+    const OutgoingHttpMessage::sptr response = std::tr1::dynamic_pointer_cast<OutgoingHttpMessage>(message);
+    OutgoingHttpMessage::sptr shared;
+
+    std::map<uint64_t, std::pair<std::string, unsigned int> >::iterator key = cache_keys_.find(sequence);
+    if (key != cache_keys_.end()) {
+      // Response to HEAD may lack the body GET would get, it is never stored under their key.
+      if (response && head_requests_.find(sequence) == head_requests_.end()) {
+        shared = GetHandler_()->GetResponseCache()->Store(key->second.first, key->second.second, *response, ::time(0));
+      }
+      cache_keys_.erase(key);
+    }
+
+    std::map<uint64_t, std::string>::iterator flight = flights_.find(sequence);
+    if (flight != flights_.end()) {
+      if (response) {
+        GetHandler_()->GetRequestCoalescer()->Complete(flight->second, response, shared);
+      }
+      else {
+        GetHandler_()->GetRequestCoalescer()->Abandon(flight->second);
+      }
+      flights_.erase(flight);
+    }
+
+    if (http10_requests_.erase(sequence) != 0 && response && !response->IsImmutable()) {
+      response->SetCloseDelimited();
+    }
+
+    if (head_requests_.erase(sequence) != 0 && response) {
+      // Shared responses are never changed, they come with a ready head-only twin.
+      if (response->IsImmutable()) {
+        message = response->GetHeadOnlyTwin();
+      }
+      else {
+        response->SetHeadOnly(true);
+      }
+    }
+  }
+
+
+  void HttpConnection::AfterEventWrite_(const OutgoingMessage::sptr& message, const uint64_t sequence, const RequestPhases* phases) {
+    size_t route = WebserverStatus::NO_ROUTE;
+
+    std::map<uint64_t, size_t>::iterator i = routes_.find(sequence);
+    if (i != routes_.end()) {
+      route = i->second;
+      routes_.erase(i);
+    }
+
+    const OutgoingHttpMessage::sptr response = std::tr1::dynamic_pointer_cast<OutgoingHttpMessage>(message);
+    Status::Self()->ServedRequest(response, route);
+    if (phases) {
+      Status::Self()->TimedRequest(*phases);
+    }
+
+    if (sequence == sampled_sequence_) {
+      if (phases && response) {
+        GetHandler_()->GetSlowRequestLog()->Record(sampled_, *response, *phases);
+      }
+      sampled_sequence_ = NO_SEQUENCE;
+    }
   }
 
 } // namespace webserver
@@ -6,9 +6,14 @@
 #define WEBSERVER_HTTP_CONNECTION_H__
 
 #include "baseconnection.h"
+#include "incominghttpmessage.h"
 #include "outgoinghttpmessage.h"
 #include "server.h"
 
+#include <map>
+#include <set>
+#include <string>
+
 namespace webserver {
 
   class HttpConnection : public BaseConnection {
@@ -16,6 +21,8 @@ namespace webserver {
     typedef std::tr1::shared_ptr<HttpConnection> sptr;
     typedef std::tr1::weak_ptr<HttpConnection> wptr;
 
+    ~HttpConnection();
+
     // Outgoing connection
     static sptr Create(const std::string& local, const std::string& remote, const uint16_t port,
                        bool is_persistent, Server::sptr& handler);
@@ -30,9 +37,38 @@ namespace webserver {
     HttpConnection(const sockets::SocketFd& fd, Server::sptr& handler);
 
     void ProcessEventRead_(base::CString& buffer);
-    void AfterEventWrite_(const OutgoingMessage::sptr& message);
+    // Answers message which can not be read any further and stops reading the connection,
+    // which is closed once the response is written.
+    void Reject_(const IncomingHttpMessage::sptr& message, const OutgoingHttpMessage::sptr& response, base::CString& buffer);
+    // Answers metrics scrapes and requests found in the response cache or joins request to
+    // identical one in flight, otherwise passes it to handlers. Keys are remembered, so the
+    // response is stored and shared once it is sent.
+    void Dispatch_(const IncomingHttpMessage::sptr& request);
+    void BeforeSerialize_(OutgoingMessage::sptr& message, const uint64_t sequence);
+    void AfterEventWrite_(const OutgoingMessage::sptr& message, const uint64_t sequence, const RequestPhases* phases);
 
     bool buffer_has_bad_data_;
+    // Request was rejected, whatever follows it is dropped.
+    bool is_rejected_;
+    // Message with incomplete body, its deserialization is resumed on the next read.
+    IncomingHttpMessage::sptr pending_;
+    // Bytes of the pending message consumed so far.
+    size_t pending_length_;
+    // Time of the read which brought the first byte of the pending message.
+    uint64_t pending_since_;
+    // Sequences of HEAD requests, responses to them are sent without body.
+    std::set<uint64_t> head_requests_;
+    // Sequences of HTTP/1.0 requests, streamed responses to them are close-delimited.
+    std::set<uint64_t> http10_requests_;
+    // Cache keys and time to live of responses to be cached, by request sequence.
+    std::map<uint64_t, std::pair<std::string, unsigned int> > cache_keys_;
+    // Coalescer keys of requests leading flights, by request sequence.
+    std::map<uint64_t, std::string> flights_;
+    // Status routes of requests, by request sequence.
+    std::map<uint64_t, size_t> routes_;
+    // Request followed by the slow request log, one at a time, and its sequence.
+    SlowRequestLog::Entry sampled_;
+    uint64_t sampled_sequence_;
   };
 
 } // namespace webserver
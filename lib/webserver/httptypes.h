@@ -19,17 +19,37 @@ namespace webserver {
   typedef enum {
     RESPONSE,
     POST,
-    GET
+    GET,
+    HEAD,
+    PUT,
+    DELETE,
+    OPTIONS,
+    PATCH
   } HttpMethod;
 
+  const unsigned int HTTP_METHODS_COUNT = 8;
+
+  const char* const HTTP_METHODS[HTTP_METHODS_COUNT] = {
+    "RESPONSE",
+    "POST",
+    "GET",
+    "HEAD",
+    "PUT",
+    "DELETE",
+    "OPTIONS",
+    "PATCH"
+  };
+
   typedef enum {
     HTTP_OK,
     HTTP_NO_CONTENT,
+    HTTP_NOT_MODIFIED,
     HTTP_BAD_REQUEST,
     HTTP_FORBIDDEN,
     HTTP_NOT_FOUND,
     HTTP_NOT_ACCEPTABLE,
     HTTP_TIMEOUT,
+    HTTP_ENTITY_TOO_LARGE,
     HTTP_TOO_MANY_CONNECTIONS,
   } HttpCode;
 
@@ -39,27 +59,31 @@ namespace webserver {
     HTTP_LENGTH
   } HttpCodeValue;
 
-  const unsigned int HTTP_CODES_COUNT = 8;
+  const unsigned int HTTP_CODES_COUNT = 10;
 
   const char* const HTTP_CODES[HTTP_CODES_COUNT][2] = {
     { "200", "200 OK" },
     { "204", "204 No Content" },
+    { "304", "304 Not Modified" },
     { "400", "400 Bad Request" },
     { "403", "403 Forbidden" },
     { "404", "404 Not Found" },
     { "406", "406 Not Acceptable" },
     { "408", "408 Request Timeout" },
+    { "413", "413 Request Entity Too Large" },
     { "503", "503 Too Many Connections" }
   };
 
   const size_t HTTP_CODES_LENGTH[HTTP_CODES_COUNT] = {
     6,  // 200 OK
     14, // 204 No Content
+    16, // 304 Not Modified
     15, // 400 Bad Request
     13, // 403 Forbidden
     13, // 404 Not Found
     18, // 406 Not Acceptable
     19, // 408 Request Timeout
+    28, // 413 Request Entity Too Large
     24  // 503 Too Many Connections
   };
 
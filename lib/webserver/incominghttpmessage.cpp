@@ -4,15 +4,74 @@
 
 #include "incominghttpmessage.h"
 #include "exception.h"
+#include <base/string_helpers.h>
 #include <cstring/conversions.h>
+#include <limits>
 
 
 namespace webserver {
 
+  namespace {
+
+    inline uint32_t MethodWord_(const char a, const char b, const char c, const char d) {
+      return (static_cast<uint32_t>(static_cast<unsigned char>(a)) << 24) |
+             (static_cast<uint32_t>(static_cast<unsigned char>(b)) << 16) |
+             (static_cast<uint32_t>(static_cast<unsigned char>(c)) << 8) |
+             static_cast<uint32_t>(static_cast<unsigned char>(d));
+    }
+
+    // First four bytes of the request line for every supported method.
+    enum {
+      METHOD_WORD_GET = ('G' << 24) | ('E' << 16) | ('T' << 8) | ' ',
+      METHOD_WORD_POST = ('P' << 24) | ('O' << 16) | ('S' << 8) | 'T',
+      METHOD_WORD_HEAD = ('H' << 24) | ('E' << 16) | ('A' << 8) | 'D',
+      METHOD_WORD_PUT = ('P' << 24) | ('U' << 16) | ('T' << 8) | ' ',
+      METHOD_WORD_DELETE = ('D' << 24) | ('E' << 16) | ('L' << 8) | 'E',
+      METHOD_WORD_OPTIONS = ('O' << 24) | ('P' << 16) | ('T' << 8) | 'I',
+      METHOD_WORD_PATCH = ('P' << 24) | ('A' << 16) | ('T' << 8) | 'C',
+      METHOD_WORD_RESPONSE = ('H' << 24) | ('T' << 16) | ('T' << 8) | 'P'
+    };
+
+    // Parses decimal value made of digits only, trailing whitespace aside. Returns false on
+    // anything else, including values which do not fit.
+    bool ParseLength_(const std::string& value, size_t& length) {
+      size_t end = value.length();
+      while (end > 0 && (value[end - 1] == ' ' || value[end - 1] == '\t')) {
+        --end;
+      }
+
+      if (end == 0) {
+        return false;
+      }
+
+      const size_t max = std::numeric_limits<size_t>::max();
+      length = 0;
+      for (size_t i = 0; i < end; ++i) {
+        if (value[i] < '0' || value[i] > '9') {
+          return false;
+        }
+
+        const size_t digit = static_cast<size_t>(value[i] - '0');
+        if (length > (max - digit) / 10) {
+          return false;
+        }
+        length = length * 10 + digit;
+      }
+
+      return true;
+    }
+
+  } // namespace
+
+
   IncomingHttpMessage::IncomingHttpMessage()
   : method_(webserver::RESPONSE)
   , length_(0)
-  , is_persistent_(false) { }
+  , is_persistent_(false)
+  , is_chunked_(false)
+  , is_http10_(false)
+  , is_header_parsed_(false)
+  , is_complete_(false) { }
 
 
   IncomingHttpMessage::~IncomingHttpMessage() { }
@@ -33,6 +92,41 @@ namespace webserver {
   }
 
 
+  bool IncomingHttpMessage::IsChunked() const {
+    return is_chunked_;
+  }
+
+
+  bool IncomingHttpMessage::IsHttp10() const {
+    return is_http10_;
+  }
+
+
+  bool IncomingHttpMessage::IsHeaderParsed() const {
+    return is_header_parsed_;
+  }
+
+
+  bool IncomingHttpMessage::IsComplete() const {
+    return is_complete_;
+  }
+
+
+  size_t IncomingHttpMessage::GetContentLength() const {
+    return length_;
+  }
+
+
+  const MessageBody& IncomingHttpMessage::GetBody() const {
+    return body_;
+  }
+
+
+  size_t IncomingHttpMessage::ReadBody(char* buffer, const size_t length) {
+    return body_.Read(buffer, length);
+  }
+
+
   const IncomingHttpMessage::HttpPairList& IncomingHttpMessage::GetHeaders() const {
     return headers_;
   }
@@ -76,30 +170,66 @@ namespace webserver {
   //
   // Deserialization wrapper.
   //
+  // If request holds a message, which header was deserialized on previous call, but body
+  // was incomplete, deserialization is resumed: data is expected to start with the rest
+  // of the body. Otherwise new message is created, and if sinks factory is given, it
+  // is asked for the body sink right after the header is parsed.
+  //
+  // Content-Length over max_body_length is refused before any of the body is read,
+  // chunked body as soon as it grows over it.
+  //
+  // Once the header is parsed, end is set to amount of data consumed even if false is
+  // returned, so consumed body may be released from the buffer right away.
+  //
   // Returns:
   //   true, on success;
   //   false, on incomplete data.
   //
+  // Throws:
+  //   DeserializationError, on erroneous data;
+  //   InvalidRequestError, on invalid Content-Length;
+  //   BodyTooLargeError, on body over the limit;
+  //   IOException, if body could not be spilled.
+  //
 
-  bool IncomingHttpMessage::Deserialize(IncomingHttpMessage::sptr& request, const base::CString& data, size_t& eof) {
-    if (data.IsEmpty()) {
+  bool IncomingHttpMessage::Deserialize(IncomingHttpMessage::sptr& request, const base::CString& data, size_t& eof,
+                                        BodySinkFactory* sinks, const size_t max_body_length) {
+    if (data.Length() == 0) {
       return false;
     }
 
-    request = sptr(new IncomingHttpMessage());
-
-    if (!request->DeserializeMethod_(data, eof)) {
-      return false;
+    if (request && request->is_header_parsed_ && !request->is_complete_) {
+      eof = 0;
     }
+    else {
+      request = sptr(new IncomingHttpMessage());
 
-    if (!request->DeserializeHeader_(data, eof)) {
-      return false;
+      if (!request->DeserializeMethod_(data, eof)) {
+        return false;
+      }
+
+      if (!request->DeserializeHeader_(data, eof)) {
+        return false;
+      }
+
+      request->is_header_parsed_ = true;
+
+      if (max_body_length != 0 && !request->is_chunked_ && request->length_ > max_body_length) {
+        base_throw(BodyTooLargeError, "Content-Length " + base::ToString(request->length_));
+      }
+
+      if (sinks) {
+        request->body_.SetSink(sinks->Create(*request));
+      }
     }
 
-    if (!request->DeserializeQuery_(data, eof)) {
+    if (!request->DeserializeBody_(data, eof, max_body_length)) {
       return false;
     }
 
+    request->body_.Finish();
+    request->DeserializeQuery_();
+    request->is_complete_ = true;
     return true;
   }
 
@@ -125,26 +255,58 @@ namespace webserver {
       eof += 2;
     }
 
-    // Parse method: GET, POST or response.
+    // Parse method: first four bytes of the line are read as a single word and dispatched
+    // at once, then the rest of the method name is checked.
     {
-      // Methods are ordered by usage frequency from most used to least used: POST, GET, HTTP/1.1, HTTP/1.0.
-      if (request.Compare("POST ", 0, 5) == 0) {
-        method_ = POST;
-        p += 5;
-      }
-      else if (request.Compare("GET ", 0, 4) == 0) {
-        method_ = GET;
-        p += 4;
-      }
-      else if (request.Compare("HTTP/1.1 ", 0, 9) == 0) {
-        method_ = RESPONSE;
-        p += 9;
-      }
-      else if (request.Compare("HTTP/1.0 ", 0, 9) == 0) {
-        method_ = RESPONSE;
-        p += 9;
+      const char* line = request.Str();
+      const uint32_t word = eof >= 6 ? MethodWord_(line[0], line[1], line[2], line[3]) : 0;
+      bool is_valid = true;
+
+      switch (word) {
+        case METHOD_WORD_GET:
+          method_ = GET;
+          p += 4;
+          break;
+        case METHOD_WORD_POST:
+          is_valid = line[4] == ' ';
+          method_ = POST;
+          p += 5;
+          break;
+        case METHOD_WORD_HEAD:
+          is_valid = line[4] == ' ';
+          method_ = HEAD;
+          p += 5;
+          break;
+        case METHOD_WORD_PUT:
+          method_ = PUT;
+          p += 4;
+          break;
+        case METHOD_WORD_DELETE:
+          is_valid = request.Compare("TE ", 4, 3) == 0;
+          method_ = DELETE;
+          p += 7;
+          break;
+        case METHOD_WORD_OPTIONS:
+          is_valid = request.Compare("ONS ", 4, 4) == 0;
+          method_ = OPTIONS;
+          p += 8;
+          break;
+        case METHOD_WORD_PATCH:
+          is_valid = request.Compare("H ", 4, 2) == 0;
+          method_ = PATCH;
+          p += 6;
+          break;
+        case METHOD_WORD_RESPONSE:
+          is_valid = request.Compare("/1.1 ", 4, 5) == 0 || request.Compare("/1.0 ", 4, 5) == 0;
+          method_ = RESPONSE;
+          p += 9;
+          break;
+        default:
+          is_valid = false;
+          break;
       }
-      else {
+
+      if (!is_valid || p >= eof) {
         base::CString error("Invalid method: ", 16);
         error.Append(request.Substring(0, eof));
         base_throw(DeserializationError, error.Str());
@@ -159,7 +321,7 @@ namespace webserver {
         base_throw(DeserializationError, error.Str());
       }
     }
-    else { // POST or GET
+    else { // Request
       size_t pp = request.Pos(" HTTP/1.", p);
       if (pp == base::CString::npos) {
         base::CString error("Invalid protocol: ", 18);
@@ -168,6 +330,7 @@ namespace webserver {
       }
 
       uri_ = request.Substring(p, pp - p).Str();
+      is_http10_ = request.Length() > pp + 8 && request.Compare("0", pp + 8, 1) == 0;
     }
 
     return true;
@@ -181,7 +344,8 @@ namespace webserver {
   //   false, on incomplete data.
   //
   // Throws:
-  //   DeserializationError, on erroneous data.
+  //   DeserializationError, on erroneous data;
+  //   InvalidRequestError, on invalid Content-Length.
   //
 
   bool IncomingHttpMessage::DeserializeHeader_(const base::CString& request, size_t& eof) {
@@ -190,7 +354,8 @@ namespace webserver {
     }
 
     const char* p = request.Str() + eof;
-    bool header_line_end = false;
+    // Request line is already terminated by CRLF, so empty header is valid.
+    bool header_line_end = true;
     bool header_end = false;
 
     while (*p) {
@@ -239,7 +404,14 @@ namespace webserver {
           headers_.push_back(pair);
 
           if (::strcasecmp(pair->key.c_str(), "content-length") == 0) {
-            length_ = ::strtoul(pair->value.c_str(), 0, 10);
+            if (!ParseLength_(pair->value, length_)) {
+              base_throw(InvalidRequestError, "Invalid Content-Length: " + pair->value);
+            }
+          }
+          else if (::strcasecmp(pair->key.c_str(), "transfer-encoding") == 0) {
+            // Chunked coding is always the last one applied, e.g. "gzip, chunked".
+            const size_t len = pair->value.length();
+            is_chunked_ = len >= 7 && ::strcasecmp(pair->value.c_str() + len - 7, "chunked") == 0;
           }
           else if (::strcasecmp(pair->key.c_str(), "connection") == 0) {
             is_persistent_ = ::strcasecmp(pair->value.c_str(), "keep-alive") == 0;
@@ -249,75 +421,81 @@ namespace webserver {
           }
         }
       }
+      else {
+        base_throw(DeserializationError, "Invalid header line");
+      }
     }
 
     return header_end;
   }
 
   //
-  // Method to deserialize query part of URI in GET request, or content in POST request.
+  // Method to deserialize message body, either of Content-Length size, or chunked one.
+  // Body is consumed as far as data goes, chunked body decoder keeps its state in the
+  // message between calls.
   //
   // Returns:
   //   true, on success;
   //   false, on incomplete data.
   //
   // Throws:
-  //   DeserializationError, on erroneous data.
+  //   DeserializationError, on erroneous data;
+  //   BodyTooLargeError, on chunked body over the limit.
   //
 
-  bool IncomingHttpMessage::DeserializeQuery_(const base::CString& request, size_t& eof) {
-    const char* p;
-
-    if (method_ == GET) {
-      p = ::strstr(uri_.c_str(), "?");
-      eof += length_;
+  bool IncomingHttpMessage::DeserializeBody_(const base::CString& request, size_t& eof, const size_t max_body_length) {
+    const size_t available = eof < request.Length() ? request.Length() - eof : 0;
 
-      if (p == 0) {
-        return true;
+    if (is_chunked_) {
+      eof += decoder_.Decode(request.Str() + eof, available, body_);
+      if (max_body_length != 0 && body_.Length() > max_body_length) {
+        base_throw(BodyTooLargeError, "Chunked body over " + base::ToString(max_body_length));
       }
+      return decoder_.IsDone();
     }
-    else if (method_ == POST || method_ == RESPONSE) {
-      if (eof + length_ > request.Length()) {
-        return false;
-      }
 
-      p = request.Str() + eof;
-      eof += length_;
-    }
-    else {
-      eof += length_;
-      return true;
-    }
+    const size_t left = length_ - body_.Length();
+    const size_t n = available < left ? available : left;
+    body_.Append(request.Str() + eof, n);
+    eof += n;
+    return body_.Length() == length_;
+  }
 
-    while (*p) {
-      HttpPair pair = HttpPair(new _HttpPair());
+  //
+  // Method to deserialize query part of URI in requests without content (GET, HEAD, DELETE,
+  // OPTIONS), or content in the others. Content is parsed only if it is kept in memory.
+  // Keys and values are percent-decoded.
+  //
 
-      while (*p == '?' || *p == '&') {
-        ++p;
-      }
+  void IncomingHttpMessage::DeserializeQuery_() {
+    const char* p;
+    size_t len;
 
-      // Get key if key is present.
-      while (*p != '=' && *p) {
-        pair->key.append(1, *p++);
-      }
+    if (method_ == GET || method_ == HEAD || method_ == DELETE || method_ == OPTIONS) {
+      const size_t pos = uri_.find('?');
 
-      while (*p == '=') {
-        p++;
+      if (pos == std::string::npos) {
+        return;
       }
 
-      // Get value.
-      if (!pair->key.empty()) {
-        while (*p != '&' && *p) {
-          pair->value.append(1, *p++);
-        }
-
-        if (!pair->value.empty()) {
-          queries_.push_back(pair);
-        }
-      }
+      p = uri_.data() + pos;
+      len = uri_.length() - pos;
+    }
+    else if (!body_.IsEmpty() && !body_.IsSpilled() && !body_.GetSink()) {
+      p = body_.Data();
+      len = body_.Length();
+    }
+    else {
+      return;
     }
 
-    return true;
+    base::QueryTokenizer tokenizer(p, len);
+    HttpPair pair = HttpPair(new _HttpPair());
+
+    while (tokenizer.Next(pair->key, pair->value)) {
+      queries_.push_back(pair);
+      pair = HttpPair(new _HttpPair());
+    }
   }
 
 } // namespace webserver
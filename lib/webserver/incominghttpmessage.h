@@ -5,8 +5,10 @@
 #ifndef WEBSERVER_INCOMING_HTTP_MESSAGE_H__
 #define WEBSERVER_INCOMING_HTTP_MESSAGE_H__
 
+#include "chunkeddecoder.h"
 #include "httptypes.h"
 #include "message.h"
+#include "messagebody.h"
 
 #include <base/basicmacros.h>
 #include <cstring/cstring.h>
@@ -34,6 +36,17 @@ namespace webserver {
     HttpMethod GetMethod() const;
     const std::string& GetUri() const;
     bool IsPersistent() const;
+    bool IsChunked() const;
+    // Request line ends with "HTTP/1.0", client can not read chunked bodies.
+    bool IsHttp10() const;
+    bool IsHeaderParsed() const;
+    bool IsComplete() const;
+    size_t GetContentLength() const;
+
+    // Whole decoded body of the message.
+    const MessageBody& GetBody() const;
+    // Reads body sequentially, returns amount of bytes copied into buffer.
+    size_t ReadBody(char* buffer, const size_t length);
 
     const HttpPairList& GetHeaders() const;
     const HttpPairList& GetQueries() const;
@@ -41,17 +54,27 @@ namespace webserver {
     bool FindQuery(const char* key, HttpPair& query) const;
     bool GetRequestId(HttpPair& reqid) const;
 
-    static bool Deserialize(sptr& request, const base::CString& data, size_t& end);
+    // Body longer than max_body_length is refused, zero allows any length.
+    static bool Deserialize(sptr& request, const base::CString& data, size_t& end, BodySinkFactory* sinks = 0,
+                            const size_t max_body_length = 0);
 
   private:
     bool DeserializeMethod_(const base::CString& request, size_t& end);
     bool DeserializeHeader_(const base::CString& request, size_t& end);
-    bool DeserializeQuery_(const base::CString& request, size_t& end);
+    bool DeserializeBody_(const base::CString& request, size_t& end, const size_t max_body_length);
+    void DeserializeQuery_();
 
     HttpMethod method_;
     std::string uri_;
     size_t length_;
     bool is_persistent_;
+    bool is_chunked_;
+    bool is_http10_;
+    bool is_header_parsed_;
+    bool is_complete_;
+
+    MessageBody body_;
+    ChunkedDecoder decoder_;
 
     HttpPairList headers_;
     HttpPairList queries_;
@@ -0,0 +1,306 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "latencyhistogram.h"
+
+#include <cmath>
+#include <cstring>
+
+
+namespace webserver {
+
+  namespace {
+    const size_t HALF_SUB_BUCKETS = 1 << (LatencyHistogram::SUB_BUCKET_BITS - 1);
+
+
+    unsigned int Cap(const uint64_t value, const uint64_t max) {
+      return static_cast<unsigned int>(value < max ? value : max);
+    }
+  }
+
+
+  const size_t LatencyHistogram::SUB_BUCKET_BITS;
+  const size_t LatencyHistogram::BUCKETS_COUNT;
+  const uint64_t LatencyHistogram::MAX_VALUE;
+
+
+  LatencyHistogram::LatencyHistogram() {
+    Clear();
+  }
+
+
+  void LatencyHistogram::Record(const uint64_t value) {
+    ++counts_[GetBucket(value)];
+    ++count_;
+    if (value > max_) {
+      max_ = value;
+    }
+  }
+
+
+  void LatencyHistogram::Add(const LatencyHistogram& histogram) {
+    for (size_t i = 0; i < BUCKETS_COUNT; ++i) {
+      counts_[i] += histogram.counts_[i];
+    }
+    count_ += histogram.count_;
+    if (histogram.max_ > max_) {
+      max_ = histogram.max_;
+    }
+  }
+
+
+  void LatencyHistogram::Subtract(const LatencyHistogram& histogram) {
+    for (size_t i = 0; i < BUCKETS_COUNT; ++i) {
+      counts_[i] -= histogram.counts_[i];
+    }
+    count_ -= histogram.count_;
+  }
+
+
+  void LatencyHistogram::Clear() {
+    ::memset(counts_, 0, sizeof(counts_));
+    count_ = 0;
+    max_ = 0;
+  }
+
+
+  uint64_t LatencyHistogram::GetCount() const {
+    return count_;
+  }
+
+
+  uint64_t LatencyHistogram::GetMax() const {
+    return max_;
+  }
+
+
+  uint64_t LatencyHistogram::GetPercentile(const double percentile) const {
+    if (count_ == 0) {
+      return 0;
+    }
+
+    uint64_t rank = static_cast<uint64_t>(::ceil(percentile / 100.0 * static_cast<double>(count_)));
+    if (rank == 0) {
+      rank = 1;
+    }
+
+    uint64_t seen = 0;
+    for (size_t i = 0; i < BUCKETS_COUNT; ++i) {
+      seen += counts_[i];
+      if (seen >= rank) {
+        const uint64_t limit = GetBucketLimit(i);
+        return limit < max_ || max_ == 0 ? limit : max_;
+      }
+    }
+
+    return max_;
+  }
+
+
+  uint64_t LatencyHistogram::GetBucketCount(const size_t bucket) const {
+    return counts_[bucket];
+  }
+
+
+  LatencyPercentiles LatencyHistogram::Summarize() const {
+    return Summarize(max_);
+  }
+
+
+  LatencyPercentiles LatencyHistogram::Summarize(const uint64_t max) const {
+    // Bucket limits may lie above the maximum actually seen.
+    const uint64_t limit = count_ ? Cap(max, MAX_VALUE) : 0;
+
+    LatencyPercentiles percentiles;
+    percentiles.count = count_;
+    percentiles.p50 = Cap(GetPercentile(50.0), limit);
+    percentiles.p90 = Cap(GetPercentile(90.0), limit);
+    percentiles.p99 = Cap(GetPercentile(99.0), limit);
+    percentiles.p999 = Cap(GetPercentile(99.9), limit);
+    percentiles.max = static_cast<unsigned int>(limit);
+    return percentiles;
+  }
+
+
+  size_t LatencyHistogram::GetBucket(uint64_t value) {
+    if (value > MAX_VALUE) {
+      value = MAX_VALUE;
+    }
+
+    if (value < 2 * HALF_SUB_BUCKETS) {
+      return static_cast<size_t>(value);
+    }
+
+    const size_t shift = 63 - __builtin_clzll(value) - (SUB_BUCKET_BITS - 1);
+    return shift * HALF_SUB_BUCKETS + static_cast<size_t>(value >> shift);
+  }
+
+
+  uint64_t LatencyHistogram::GetBucketLimit(const size_t bucket) {
+    if (bucket < 2 * HALF_SUB_BUCKETS) {
+      return bucket;
+    }
+
+    const size_t shift = bucket / HALF_SUB_BUCKETS - 1;
+    const uint64_t sub_bucket = bucket - shift * HALF_SUB_BUCKETS;
+    return ((sub_bucket + 1) << shift) - 1;
+  }
+
+
+  LatencyRecorder::LatencyRecorder() {
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS_COUNT; ++i) {
+      counts_[i] = 0;
+    }
+    max_ = 0;
+  }
+
+
+  void LatencyRecorder::Record(const uint64_t value) {
+    counts_[LatencyHistogram::GetBucket(value)].fetch_and_increment();
+
+    uint64_t max = max_;
+    while (value > max) {
+      const uint64_t seen = max_.compare_and_swap(value, max);
+      if (seen == max) {
+        break;
+      }
+      max = seen;
+    }
+  }
+
+
+  void LatencyRecorder::Drain(LatencyHistogram& histogram) {
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS_COUNT; ++i) {
+      if (counts_[i] != 0) {
+        const uint32_t count = counts_[i].fetch_and_store(0);
+        histogram.counts_[i] += count;
+        histogram.count_ += count;
+      }
+    }
+
+    const uint64_t max = max_.fetch_and_store(0);
+    if (max > histogram.max_) {
+      histogram.max_ = max;
+    }
+  }
+
+
+  LatencyWindows::LatencyWindows()
+  : seconds_(SECONDS_COUNT)
+  , minutes_(MINUTES_COUNT)
+  , second_position_(0)
+  , minute_position_(0) {
+    ::pthread_key_create(&recorder_key_, 0);
+    ::memset(percentiles_, 0, sizeof(percentiles_));
+  }
+
+
+  LatencyWindows::~LatencyWindows() {
+    ::pthread_key_delete(recorder_key_);
+
+    for (std::vector<LatencyRecorder*>::iterator i = recorders_.begin(); i != recorders_.end(); ++i) {
+      delete *i;
+    }
+  }
+
+
+  void LatencyWindows::Record(const uint64_t value) {
+    GetRecorder_()->Record(value);
+  }
+
+
+  void LatencyWindows::Tick() {
+    LatencyHistogram& second = seconds_[second_position_];
+    window_1_.Subtract(second);
+    second.Clear();
+
+    std::vector<LatencyRecorder*> recorders;
+    {
+      tbb::spin_mutex::scoped_lock lock(recorders_mutex_);
+      recorders = recorders_;
+    }
+
+    for (std::vector<LatencyRecorder*>::iterator i = recorders.begin(); i != recorders.end(); ++i) {
+      (*i)->Drain(second);
+    }
+
+    window_1_.Add(second);
+    minute_.Add(second);
+
+    if (++second_position_ == SECONDS_COUNT) {
+      second_position_ = 0;
+
+      // Minute is over: it replaces the oldest one in 15-minute window and the one before
+      // last four in 5-minute window.
+      window_15_.Subtract(minutes_[minute_position_]);
+      window_5_.Subtract(minutes_[(minute_position_ + MINUTES_COUNT - 4) % MINUTES_COUNT]);
+      minutes_[minute_position_] = minute_;
+      window_5_.Add(minute_);
+      window_15_.Add(minute_);
+      minute_.Clear();
+
+      if (++minute_position_ == MINUTES_COUNT) {
+        minute_position_ = 0;
+      }
+    }
+
+    // Subtracted histograms leave their maximums behind, so those are gathered separately.
+    uint64_t max = 0;
+    for (std::vector<LatencyHistogram>::const_iterator i = seconds_.begin(); i != seconds_.end(); ++i) {
+      max = i->GetMax() > max ? i->GetMax() : max;
+    }
+    Summarize_(WINDOW_1, window_1_, max);
+
+    max = minute_.GetMax();
+    for (size_t i = 1; i <= MINUTES_COUNT; ++i) {
+      const uint64_t minute_max = minutes_[(minute_position_ + MINUTES_COUNT - i) % MINUTES_COUNT].GetMax();
+      max = minute_max > max ? minute_max : max;
+
+      if (i == 4) {
+        merged_ = window_5_;
+        merged_.Add(minute_);
+        Summarize_(WINDOW_5, merged_, max);
+      }
+    }
+
+    merged_ = window_15_;
+    merged_.Add(minute_);
+    Summarize_(WINDOW_15, merged_, max);
+  }
+
+
+  LatencyPercentiles LatencyWindows::GetPercentiles(const Window window) const {
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    return percentiles_[window];
+  }
+
+
+  const LatencyHistogram& LatencyWindows::GetLastMinute() const {
+    return window_1_;
+  }
+
+
+  LatencyRecorder* LatencyWindows::GetRecorder_() {
+    LatencyRecorder* recorder = static_cast<LatencyRecorder*>(::pthread_getspecific(recorder_key_));
+    if (!recorder) {
+      recorder = new LatencyRecorder();
+      ::pthread_setspecific(recorder_key_, recorder);
+
+      // Recorders stay until windows are destroyed, whatever is recorded is never lost to
+      // a finished thread.
+      tbb::spin_mutex::scoped_lock lock(recorders_mutex_);
+      recorders_.push_back(recorder);
+    }
+    return recorder;
+  }
+
+
+  void LatencyWindows::Summarize_(const Window window, const LatencyHistogram& histogram, const uint64_t max) {
+    const LatencyPercentiles percentiles = histogram.Summarize(max);
+
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    percentiles_[window] = percentiles;
+  }
+
+} // namespace webserver
@@ -0,0 +1,150 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_LATENCY_HISTOGRAM_H__
+#define WEBSERVER_LATENCY_HISTOGRAM_H__
+
+#include <base/prototype.h>
+#include <cstddef>
+#include <inttypes.h>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <vector>
+
+extern "C" {
+#include <pthread.h>
+}
+
+
+namespace webserver {
+
+  typedef struct {
+    uint64_t count;
+    unsigned int p50;
+    unsigned int p90;
+    unsigned int p99;
+    unsigned int p999;
+    unsigned int max;
+  } LatencyPercentiles;
+
+
+  //
+  // Log-linear histogram of latencies in microseconds.
+  //
+  // Values below 64 have buckets of their own, every further power of two is split into 32
+  // buckets, so any recorded value is known within 3% up to 2^32 microseconds. Larger
+  // values are counted in the last bucket.
+  //
+
+  class LatencyHistogram {
+  public:
+    static const size_t SUB_BUCKET_BITS = 6;
+    static const size_t BUCKETS_COUNT = (32 - SUB_BUCKET_BITS + 1) * (1 << (SUB_BUCKET_BITS - 1)) + (1 << (SUB_BUCKET_BITS - 1));
+    static const uint64_t MAX_VALUE = 0xffffffffULL;
+
+    LatencyHistogram();
+
+    void Record(const uint64_t value);
+    void Add(const LatencyHistogram& histogram);
+    // Removes counts of histogram which was added before, maximum is kept.
+    void Subtract(const LatencyHistogram& histogram);
+    void Clear();
+
+    uint64_t GetCount() const;
+    uint64_t GetMax() const;
+    // Highest value equivalent to the one below which percentile of values lies.
+    uint64_t GetPercentile(const double percentile) const;
+    uint64_t GetBucketCount(const size_t bucket) const;
+    LatencyPercentiles Summarize() const;
+    // Histograms which were subtracted from are given the maximum which is actually left.
+    LatencyPercentiles Summarize(const uint64_t max) const;
+
+    static size_t GetBucket(uint64_t value);
+    // Highest value counted in bucket.
+    static uint64_t GetBucketLimit(const size_t bucket);
+
+  private:
+    friend class LatencyRecorder;
+
+    uint64_t counts_[BUCKETS_COUNT];
+    uint64_t count_;
+    uint64_t max_;
+  };
+
+
+  //
+  // Histogram recorded into concurrently without locks and drained by a single reader.
+  //
+
+  class LatencyRecorder : public base::NonCopyable {
+  public:
+    LatencyRecorder();
+
+    void Record(const uint64_t value);
+    // Moves everything recorded so far into histogram.
+    void Drain(LatencyHistogram& histogram);
+
+  private:
+    tbb::atomic<uint32_t> counts_[LatencyHistogram::BUCKETS_COUNT];
+    tbb::atomic<uint64_t> max_;
+  };
+
+
+  //
+  // Latency percentiles over the last 1, 5 and 15 minutes.
+  //
+  // Every thread records into a recorder of its own, so recording threads never meet. Once a
+  // second Tick() drains recorders into the history and refreshes percentiles: the 1-minute
+  // window slides by seconds, 5 and 15-minute windows by whole minutes plus the current one.
+  //
+
+  class LatencyWindows : public base::NonCopyable {
+  public:
+    typedef enum {
+      WINDOW_1,
+      WINDOW_5,
+      WINDOW_15,
+      WINDOWS_COUNT
+    } Window;
+
+    LatencyWindows();
+    ~LatencyWindows();
+
+    void Record(const uint64_t value);
+    // Called once a second by a single thread.
+    void Tick();
+
+    LatencyPercentiles GetPercentiles(const Window window) const;
+    // Histogram of the 1-minute window, for the thread calling Tick() only.
+    const LatencyHistogram& GetLastMinute() const;
+
+  private:
+    static const size_t SECONDS_COUNT = 60;
+    static const size_t MINUTES_COUNT = 14;
+
+    LatencyRecorder* GetRecorder_();
+    void Summarize_(const Window window, const LatencyHistogram& histogram, const uint64_t max);
+
+    pthread_key_t recorder_key_;
+    tbb::spin_mutex recorders_mutex_;
+    std::vector<LatencyRecorder*> recorders_;
+
+    std::vector<LatencyHistogram> seconds_;
+    std::vector<LatencyHistogram> minutes_;
+    size_t second_position_;
+    size_t minute_position_;
+
+    LatencyHistogram minute_;
+    LatencyHistogram window_1_;
+    LatencyHistogram window_5_;
+    LatencyHistogram window_15_;
+    LatencyHistogram merged_;
+
+    mutable tbb::spin_mutex percentiles_mutex_;
+    LatencyPercentiles percentiles_[WINDOWS_COUNT];
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_LATENCY_HISTOGRAM_H__
@@ -6,22 +6,44 @@
 
 namespace webserver {
 
-  IncomingMessage::IncomingMessage() { }
+  IncomingMessage::IncomingMessage()
+  : timer_(clocks::Timestamp::Now())
+  , sequence_(0) { }
 
 
   IncomingMessage::~IncomingMessage() { }
 
 
-  clocks::HiResTimer& IncomingMessage::GetTimer() {
+  const clocks::Timestamp& IncomingMessage::GetTimer() const {
     return timer_;
   }
 
 
-  void IncomingMessage::SetTimer(const clocks::HiResTimer& timer) {
+  void IncomingMessage::SetTimer(const clocks::Timestamp& timer) {
     timer_ = timer;
   }
 
 
+  void IncomingMessage::SetSequence(const uint64_t sequence) {
+    sequence_ = sequence;
+  }
+
+
+  uint64_t IncomingMessage::GetSequence() const {
+    return sequence_;
+  }
+
+
+  RequestPhases& IncomingMessage::GetPhases() {
+    return phases_;
+  }
+
+
+  const RequestPhases& IncomingMessage::GetPhases() const {
+    return phases_;
+  }
+
+
   OutgoingMessage::OutgoingMessage()
   : is_persistent_(false) { }
 
@@ -39,12 +61,36 @@ namespace webserver {
   }
 
 
-  clocks::HiResTimer& OutgoingMessage::GetTimer() {
+  const FileBody* OutgoingMessage::GetFileBody() const {
+    return 0;
+  }
+
+
+  bool OutgoingMessage::IsComplete() const {
+    return true;
+  }
+
+
+  void OutgoingMessage::Attach(const std::tr1::weak_ptr<BaseConnection>& connection) {
+    static_cast<void>(connection);
+  }
+
+
+  bool OutgoingMessage::Written(const size_t offset) {
+    static_cast<void>(offset);
+    return true;
+  }
+
+
+  void OutgoingMessage::Abort() { }
+
+
+  const clocks::Timestamp& OutgoingMessage::GetTimer() const {
     return timer_;
   }
 
 
-  void OutgoingMessage::SetTimer(const clocks::HiResTimer& timer) {
+  void OutgoingMessage::SetTimer(const clocks::Timestamp& timer) {
     timer_ = timer;
   }
 
@@ -5,13 +5,23 @@
 #ifndef WEBSERVER_MESSAGE_H__
 #define WEBSERVER_MESSAGE_H__
 
+#include "requestphases.h"
+
 #include <base/prototype.h>
-#include <clock/hirestimer.h>
+#include <clock/timestamp.h>
+#include <inttypes.h>
 #include <tr1/memory>
 
+extern "C" {
+#include <sys/uio.h>
+}
+
 
 namespace webserver {
 
+  class BaseConnection;
+  class FileBody;
+
   class IncomingMessage : public base::NonCopyable {
   public:
     typedef std::tr1::shared_ptr<IncomingMessage> sptr;
@@ -19,11 +29,22 @@ namespace webserver {
     IncomingMessage();
     virtual ~IncomingMessage();
 
-    void SetTimer(const clocks::HiResTimer& timer);
-    clocks::HiResTimer& GetTimer();
+    // Moment message was received, taken when it is created.
+    void SetTimer(const clocks::Timestamp& timer);
+    const clocks::Timestamp& GetTimer() const;
+
+    // Position of the message among those received on its connection.
+    void SetSequence(const uint64_t sequence);
+    uint64_t GetSequence() const;
+
+    // Phases up to the moment handler took the message.
+    RequestPhases& GetPhases();
+    const RequestPhases& GetPhases() const;
 
   private:
-    clocks::HiResTimer timer_;
+    clocks::Timestamp timer_;
+    uint64_t sequence_;
+    RequestPhases phases_;
   };
 
 
@@ -37,16 +58,33 @@ namespace webserver {
     virtual void SetPersistence(const bool is_persistent);
     bool IsPersistent() const;
 
-    void SetTimer(const clocks::HiResTimer& timer);
-    clocks::HiResTimer& GetTimer();
+    // Moment request answered was received, latency is measured from it when set.
+    void SetTimer(const clocks::Timestamp& timer);
+    const clocks::Timestamp& GetTimer() const;
 
     virtual void Serialize() = 0;
-    virtual const char* GetSerializedMessage() const = 0;
+    // Serialized message is a sequence of memory segments which are written to the socket
+    // as they are, without being joined. Fills at most count segments with the message
+    // bytes starting from offset and returns the amount of segments filled.
+    virtual size_t GetSegments(const size_t offset, iovec* segments, const size_t count) const = 0;
+    // Part of a file sent after the segments, if any. It is included in the length.
+    virtual const FileBody* GetFileBody() const;
     virtual size_t GetLength() const = 0;
 
+    // Streamed messages grow while they are written: length covers data queued so far and
+    // message is complete when nothing more follows. Other messages are always complete.
+    virtual bool IsComplete() const;
+    // Called on server's thread when message is queued on the connection.
+    virtual void Attach(const std::tr1::weak_ptr<BaseConnection>& connection);
+    // Called on server's thread as message bytes up to offset are written. Returns false if
+    // writer has to wait: message wakes connection up once it has more data.
+    virtual bool Written(const size_t offset);
+    // Connection was closed before the message was written.
+    virtual void Abort();
+
   private:
     bool is_persistent_;
-    clocks::HiResTimer timer_;
+    clocks::Timestamp timer_;
   };
 
 } // namespace webserver
@@ -0,0 +1,188 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "messagebody.h"
+
+#include <base/c_format.h>
+#include <base/exception.h>
+#include <cerrno>
+#include <cstring>
+#include <vector>
+
+extern "C" {
+#include <stdlib.h>
+#include <sys/mman.h>
+#include <unistd.h>
+}
+
+
+namespace webserver {
+
+  size_t MessageBody::spill_threshold_ = 1024 * 1024;
+  std::string MessageBody::temporary_directory_ = "/tmp";
+
+
+  MessageBody::MessageBody()
+  : length_(0)
+  , read_(0)
+  , fd_(-1)
+  , map_(0) { }
+
+
+  MessageBody::~MessageBody() {
+    if (map_) {
+      ::munmap(map_, length_);
+    }
+
+    if (fd_ != -1) {
+      ::close(fd_);
+    }
+  }
+
+
+  void MessageBody::SetSink(const BodySink::sptr& sink) {
+    sink_ = sink;
+  }
+
+
+  const BodySink::sptr& MessageBody::GetSink() const {
+    return sink_;
+  }
+
+
+  void MessageBody::Append(const char* data, const size_t len) {
+    if (len == 0) {
+      return;
+    }
+
+    if (sink_) {
+      sink_->Write(data, len);
+    }
+    else if (fd_ != -1) {
+      Write_(data, len);
+    }
+    else if (length_ + len > spill_threshold_) {
+      Spill_();
+      Write_(data, len);
+    }
+    else {
+      memory_.append(data, len);
+    }
+
+    length_ += len;
+  }
+
+
+  void MessageBody::Finish() {
+    if (sink_) {
+      sink_->Finish();
+    }
+  }
+
+
+  size_t MessageBody::Length() const {
+    return length_;
+  }
+
+
+  bool MessageBody::IsEmpty() const {
+    return length_ == 0;
+  }
+
+
+  bool MessageBody::IsSpilled() const {
+    return fd_ != -1;
+  }
+
+
+  const char* MessageBody::Data() const {
+    if (fd_ == -1 || length_ == 0) {
+      return memory_.c_str();
+    }
+
+    if (map_ == 0) {
+      void* map = ::mmap(0, length_, PROT_READ, MAP_PRIVATE, fd_, 0);
+      if (map == MAP_FAILED) {
+        base_throw(IOException, c_format("Could not map request body: %s", ::strerror(errno)));
+      }
+      map_ = map;
+    }
+
+    return static_cast<const char*>(map_);
+  }
+
+
+  size_t MessageBody::Read(char* buffer, const size_t length) {
+    const size_t left = length_ - read_;
+    size_t n = length < left ? length : left;
+
+    if (n == 0) {
+      return 0;
+    }
+
+    if (fd_ == -1) {
+      ::memcpy(buffer, memory_.data() + read_, n);
+    }
+    else {
+      ssize_t r;
+      while ((r = ::pread(fd_, buffer, n, static_cast<off_t>(read_))) < 0 && errno == EINTR) { }
+
+      if (r < 0) {
+        base_throw(IOException, c_format("Could not read request body: %s", ::strerror(errno)));
+      }
+
+      n = static_cast<size_t>(r);
+    }
+
+    read_ += n;
+    return n;
+  }
+
+
+  void MessageBody::SetSpillThreshold(const size_t threshold) {
+    spill_threshold_ = threshold;
+  }
+
+
+  void MessageBody::SetTemporaryDirectory(const std::string& directory) {
+    temporary_directory_ = directory;
+  }
+
+
+  void MessageBody::Spill_() {
+    const std::string path = temporary_directory_ + "/webserver-body-XXXXXX";
+    std::vector<char> name(path.begin(), path.end());
+    name.push_back('\0');
+
+    if ((fd_ = ::mkstemp(&name[0])) == -1) {
+      base_throw(IOException, c_format("Could not create temporary file for request body: %s", ::strerror(errno)));
+    }
+
+    // File is only reachable by descriptor and vanishes when it is closed.
+    ::unlink(&name[0]);
+
+    Write_(memory_.data(), memory_.length());
+    std::string().swap(memory_);
+  }
+
+
+  void MessageBody::Write_(const char* data, const size_t len) {
+    size_t written = 0;
+
+    while (written < len) {
+      const ssize_t r = ::write(fd_, data + written, len - written);
+
+      if (r < 0) {
+        if (errno == EINTR) {
+          continue;
+        }
+
+        base_throw(IOException, c_format("Could not write request body: %s", ::strerror(errno)));
+      }
+
+      written += static_cast<size_t>(r);
+    }
+  }
+
+} // namespace webserver
@@ -0,0 +1,91 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_MESSAGE_BODY_H__
+#define WEBSERVER_MESSAGE_BODY_H__
+
+#include <base/prototype.h>
+#include <string>
+#include <tr1/memory>
+
+
+namespace webserver {
+
+  class IncomingHttpMessage;
+
+  // Receives pieces of request body as they arrive from the socket.
+  class BodySink {
+  public:
+    typedef std::tr1::shared_ptr<BodySink> sptr;
+
+    virtual ~BodySink() { }
+
+    virtual void Write(const char* data, const size_t len) = 0;
+    virtual void Finish() { }
+  };
+
+
+  // Decides which requests have their body streamed to a sink instead of being stored.
+  class BodySinkFactory {
+  public:
+    typedef std::tr1::shared_ptr<BodySinkFactory> sptr;
+
+    virtual ~BodySinkFactory() { }
+
+    // Called on I/O thread right after request header is parsed.
+    // Returning empty pointer keeps body stored in the message.
+    virtual BodySink::sptr Create(const IncomingHttpMessage& request) = 0;
+  };
+
+
+  //
+  // Request body storage.
+  //
+  // Body is kept in memory until it grows above spill threshold, then it is moved to
+  // an unlinked temporary file and following data is appended there. If sink is set,
+  // data is passed to it and not stored at all.
+  //
+
+  class MessageBody : public base::NonCopyable {
+  public:
+    MessageBody();
+    ~MessageBody();
+
+    void SetSink(const BodySink::sptr& sink);
+    const BodySink::sptr& GetSink() const;
+
+    void Append(const char* data, const size_t len);
+    void Finish();
+
+    size_t Length() const;
+    bool IsEmpty() const;
+    bool IsSpilled() const;
+
+    // Whole body, spilled body is mapped into memory on the first call.
+    // Not zero-terminated if spilled.
+    const char* Data() const;
+    // Reads body sequentially, returns amount of bytes copied into buffer.
+    size_t Read(char* buffer, const size_t length);
+
+    static void SetSpillThreshold(const size_t threshold);
+    static void SetTemporaryDirectory(const std::string& directory);
+
+  private:
+    void Spill_();
+    void Write_(const char* data, const size_t len);
+
+    std::string memory_;
+    size_t length_;
+    size_t read_;
+    int fd_;
+    mutable void* map_;
+    BodySink::sptr sink_;
+
+    static size_t spill_threshold_;
+    static std::string temporary_directory_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_MESSAGE_BODY_H__
@@ -0,0 +1,403 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "metricsexporter.h"
+#include "headerbuilder.h"
+#include "server.h"
+#include "status.h"
+
+#include <algorithm>
+#include <vector>
+
+extern "C" {
+#include <pthread.h>
+}
+
+
+namespace webserver {
+
+  namespace {
+    const char* const CONTENT_TYPE = "text/plain; version=0.0.4; charset=utf-8";
+
+    const char* const WINDOW_LABELS[LatencyWindows::WINDOWS_COUNT] = {
+      "window=\"1m\"",
+      "window=\"5m\"",
+      "window=\"15m\""
+    };
+
+    // Counters and distributions of ServerStats, in their order.
+    const char* const LOOP_COUNTERS[ServerStats::COUNTERS_COUNT][2] = {
+      { "webserver_loop_iterations_total", "Perform() calls." },
+      { "webserver_loop_events_total", "Events returned by poll." },
+      { "webserver_loop_wait_seconds_total", "Time spent waiting in poll." },
+      { "webserver_loop_perform_seconds_total", "Time spent in Perform() besides waiting." },
+      { "webserver_loop_handling_seconds_total", "Time spent by handlers between Perform() calls." },
+      { "webserver_poll_control_calls_total", "Calls changing the poll interest set." },
+      { "webserver_socket_reads_total", "Socket read calls." },
+      { "webserver_socket_writes_total", "Socket write calls." }
+    };
+
+    const char* const LOOP_DISTRIBUTIONS[ServerStats::DISTRIBUTIONS_COUNT][2] = {
+      { "webserver_loop_events", "Events returned by a poll, percentiles of the last complete minute." },
+      { "webserver_loop_wait_microseconds", "Time spent waiting in a poll, percentiles of the last complete minute." },
+      { "webserver_loop_perform_microseconds", "Time spent in a Perform() besides waiting, percentiles of the last complete minute." },
+      { "webserver_loop_handling_microseconds", "Time spent by handlers between Perform() calls, percentiles of the last complete minute." },
+      { "webserver_loop_activity", "Connections queued for handlers after a Perform(), percentiles of the last complete minute." },
+      { "webserver_loop_handled", "Connections taken by handlers between Perform() calls, percentiles of the last complete minute." }
+    };
+
+    pthread_key_t buffer_key;
+    pthread_once_t buffer_once = PTHREAD_ONCE_INIT;
+
+
+    void DestroyBuffer(void* p) {
+      delete static_cast<std::string*>(p);
+    }
+
+
+    void CreateBufferKey() {
+      ::pthread_key_create(&buffer_key, DestroyBuffer);
+    }
+
+
+    // Rendering buffer of calling thread, its capacity outlives scrapes.
+    std::string& GetBuffer() {
+      ::pthread_once(&buffer_once, CreateBufferKey);
+
+      std::string* buffer = static_cast<std::string*>(::pthread_getspecific(buffer_key));
+      if (!buffer) {
+        buffer = new std::string();
+        ::pthread_setspecific(buffer_key, buffer);
+      }
+      return *buffer;
+    }
+
+
+    void AppendFamily(std::string& buffer, const char* name, const char* type, const char* help) {
+      buffer.append("# HELP ").append(name).append(" ").append(help).append("\n");
+      buffer.append("# TYPE ").append(name).append(" ").append(type).append("\n");
+    }
+
+
+    void AppendSample(std::string& buffer, const char* name, const char* labels, const char* more_labels, const uint64_t value) {
+      buffer.append(name);
+
+      if (labels) {
+        buffer.append("{").append(labels);
+        if (more_labels) {
+          buffer.append(",").append(more_labels);
+        }
+        buffer.append("}");
+      }
+
+      char digits[MAX_DECIMAL_LENGTH];
+      buffer.append(" ").append(digits, FormatDecimal(value, digits)).append("\n");
+    }
+
+
+    void AppendSample(std::string& buffer, const char* name, const uint64_t value) {
+      AppendSample(buffer, name, 0, 0, value);
+    }
+
+
+    // Summary of percentiles: samples labeled by quantile and count of summarized values.
+    void AppendSummary(std::string& buffer, const char* name, const char* labels, const LatencyPercentiles& percentiles) {
+      const char* const quantiles[] = { "quantile=\"0.5\"", "quantile=\"0.9\"", "quantile=\"0.99\"", "quantile=\"0.999\"", "quantile=\"1\"" };
+      const uint64_t values[] = { percentiles.p50, percentiles.p90, percentiles.p99, percentiles.p999, percentiles.max };
+
+      for (size_t i = 0; i < sizeof(quantiles) / sizeof(quantiles[0]); ++i) {
+        if (labels) {
+          AppendSample(buffer, name, labels, quantiles[i], values[i]);
+        }
+        else {
+          AppendSample(buffer, name, quantiles[i], 0, values[i]);
+        }
+      }
+
+      buffer.append(name).append("_count");
+      if (labels) {
+        buffer.append("{").append(labels).append("}");
+      }
+      char digits[MAX_DECIMAL_LENGTH];
+      buffer.append(" ").append(digits, FormatDecimal(percentiles.count, digits)).append("\n");
+    }
+
+
+    // Times are counted in nanoseconds, exposition format wants seconds.
+    void AppendSeconds(std::string& buffer, const char* name, const char* labels, const uint64_t nanoseconds) {
+      char digits[MAX_DECIMAL_LENGTH];
+      buffer.append(name).append("{").append(labels).append("} ");
+      buffer.append(digits, FormatDecimal(nanoseconds / 1000000000ULL, digits)).append(".");
+
+      // Leading one keeps leading zeros of the fraction.
+      const size_t length = FormatDecimal(1000000000ULL + nanoseconds % 1000000000ULL, digits);
+      buffer.append(digits + 1, length - 1).append("\n");
+    }
+
+
+    // Formats route="prefix" label, escaped as exposition format requires.
+    void FormatRouteLabel(const std::string& prefix, std::string& label) {
+      label.assign("route=\"");
+      for (std::string::const_iterator i = prefix.begin(); i != prefix.end(); ++i) {
+        if (*i == '\\' || *i == '"') {
+          label.push_back('\\');
+          label.push_back(*i);
+        }
+        else if (*i == '\n') {
+          label.append("\\n");
+        }
+        else {
+          label.push_back(*i);
+        }
+      }
+      label.push_back('"');
+    }
+  }
+
+
+  MetricsExporter::MetricsExporter(const std::string& uri)
+  : uri_(uri) { }
+
+
+  const std::string& MetricsExporter::GetUri() const {
+    return uri_;
+  }
+
+
+  bool MetricsExporter::IsScrape(const IncomingHttpMessage& request) const {
+    if (request.GetMethod() != GET && request.GetMethod() != HEAD) {
+      return false;
+    }
+
+    const std::string& uri = request.GetUri();
+    return uri.compare(0, uri_.size(), uri_) == 0 && (uri.size() == uri_.size() || uri[uri_.size()] == '?');
+  }
+
+
+  void MetricsExporter::Attach(const Server& server) {
+    tbb::spin_mutex::scoped_lock lock(servers_mutex_);
+    servers_.push_back(&server);
+  }
+
+
+  void MetricsExporter::Detach(const Server& server) {
+    tbb::spin_mutex::scoped_lock lock(servers_mutex_);
+    servers_.erase(std::remove(servers_.begin(), servers_.end(), &server), servers_.end());
+  }
+
+
+  OutgoingHttpMessage::sptr MetricsExporter::Serve(const IncomingHttpMessage::sptr& request, const Server& server) const {
+    std::string& buffer = GetBuffer();
+    Render(server, buffer);
+
+    OutgoingHttpMessage::sptr response = OutgoingHttpMessage::sptr(new OutgoingHttpMessage(request->GetTimer()));
+    response->SetMethod(RESPONSE);
+    response->SetResponseCode(HTTP_OK);
+    response->SetPersistence(request->IsPersistent());
+    response->AddHeader("Content-Type", CONTENT_TYPE);
+    response->AddHeader("Cache-Control", "no-store");
+    response->SetData(buffer.data(), buffer.size());
+    return response;
+  }
+
+
+  void MetricsExporter::Render(const Server& server, std::string& buffer) const {
+    const WebserverStatus& status = *Status::Self();
+    buffer.clear();
+
+    AppendFamily(buffer, "webserver_responses_total", "counter", "Responses served, by status code.");
+    const WebserverStatus::HttpResponseTable& served = status.GetHttpServed();
+    for (unsigned int i = 0; i < HTTP_CODES_COUNT; ++i) {
+      buffer.append("webserver_responses_total{code=\"").append(HTTP_CODES[i][HTTP_CODE]).append("\"} ");
+      char digits[MAX_DECIMAL_LENGTH];
+      buffer.append(digits, FormatDecimal(served[i], digits)).append("\n");
+    }
+
+    AppendFamily(buffer, "webserver_received_bytes_total", "counter", "Bytes of requests received.");
+    AppendSample(buffer, "webserver_received_bytes_total", status.GetTrafficIn());
+    AppendFamily(buffer, "webserver_sent_bytes_total", "counter", "Bytes of responses sent.");
+    AppendSample(buffer, "webserver_sent_bytes_total", status.GetTrafficOut());
+
+    AppendFamily(buffer, "webserver_sustained_rate", "gauge", "Responses per second, averaged over window.");
+    AppendSample(buffer, "webserver_sustained_rate", WINDOW_LABELS[0], 0, status.SustainedRate1());
+    AppendSample(buffer, "webserver_sustained_rate", WINDOW_LABELS[1], 0, status.SustainedRate5());
+    AppendSample(buffer, "webserver_sustained_rate", WINDOW_LABELS[2], 0, status.SustainedRate15());
+
+    AppendFamily(buffer, "webserver_exponential_rate", "gauge", "Responses per second, averaged exponentially.");
+    AppendSample(buffer, "webserver_exponential_rate", WINDOW_LABELS[0], 0, status.ExponentialRate1());
+    AppendSample(buffer, "webserver_exponential_rate", WINDOW_LABELS[1], 0, status.ExponentialRate5());
+    AppendSample(buffer, "webserver_exponential_rate", WINDOW_LABELS[2], 0, status.ExponentialRate15());
+
+    AppendFamily(buffer, "webserver_attained_rate", "gauge", "Responses per busy second, averaged over window.");
+    AppendSample(buffer, "webserver_attained_rate", WINDOW_LABELS[0], 0, status.AttainedRate1());
+    AppendSample(buffer, "webserver_attained_rate", WINDOW_LABELS[1], 0, status.AttainedRate5());
+    AppendSample(buffer, "webserver_attained_rate", WINDOW_LABELS[2], 0, status.AttainedRate15());
+
+    AppendFamily(buffer, "webserver_max_attained_rate", "gauge", "Most responses served in a second.");
+    AppendSample(buffer, "webserver_max_attained_rate", status.MaxAttainedRate());
+
+    const LatencyPercentiles percentiles[LatencyWindows::WINDOWS_COUNT] = {
+      status.LatencyPercentiles1(),
+      status.LatencyPercentiles5(),
+      status.LatencyPercentiles15()
+    };
+
+    AppendFamily(buffer, "webserver_latency_microseconds", "summary", "Response latency percentiles over window.");
+    for (size_t i = 0; i < LatencyWindows::WINDOWS_COUNT; ++i) {
+      AppendSummary(buffer, "webserver_latency_microseconds", WINDOW_LABELS[i], percentiles[i]);
+    }
+
+    AppendFamily(buffer, "webserver_latency_samples", "gauge", "Responses measured over window.");
+    for (size_t i = 0; i < LatencyWindows::WINDOWS_COUNT; ++i) {
+      AppendSample(buffer, "webserver_latency_samples", WINDOW_LABELS[i], 0, percentiles[i].count);
+    }
+
+    AppendFamily(buffer, "webserver_phase_microseconds", "summary", "Time requests spent in phase, percentiles over window.");
+    for (size_t i = PHASE_FIRST_BYTE; i < PHASES_COUNT; ++i) {
+      for (size_t j = 0; j < LatencyWindows::WINDOWS_COUNT; ++j) {
+        const LatencyPercentiles phase = status.PhasePercentiles(static_cast<RequestPhase>(i), static_cast<LatencyWindows::Window>(j));
+        const std::string labels = std::string("phase=\"") + PHASE_NAMES[i] + "\"," + WINDOW_LABELS[j];
+        AppendSummary(buffer, "webserver_phase_microseconds", labels.c_str(), phase);
+      }
+    }
+
+    const size_t routes_count = status.GetRoutesCount();
+    if (routes_count != 0) {
+      std::vector<WebserverStatus::RouteStats> routes;
+      std::vector<std::string> labels(routes_count);
+      for (size_t i = 0; i < routes_count; ++i) {
+        routes.push_back(status.GetRouteStats(i));
+        FormatRouteLabel(routes[i].prefix, labels[i]);
+      }
+
+      AppendFamily(buffer, "webserver_route_requests_total", "counter", "Requests received, by route.");
+      for (size_t i = 0; i < routes_count; ++i) {
+        AppendSample(buffer, "webserver_route_requests_total", labels[i].c_str(), 0, routes[i].requests);
+      }
+
+      AppendFamily(buffer, "webserver_route_responses_total", "counter", "Responses served, by route and status code.");
+      for (size_t i = 0; i < routes_count; ++i) {
+        for (unsigned int code = 0; code < HTTP_CODES_COUNT; ++code) {
+          if (routes[i].responses[code] != 0) {
+            const std::string code_label = std::string("code=\"") + HTTP_CODES[code][HTTP_CODE] + "\"";
+            AppendSample(buffer, "webserver_route_responses_total", labels[i].c_str(), code_label.c_str(), routes[i].responses[code]);
+          }
+        }
+      }
+
+      AppendFamily(buffer, "webserver_route_received_bytes_total", "counter", "Bytes of requests received, by route.");
+      for (size_t i = 0; i < routes_count; ++i) {
+        AppendSample(buffer, "webserver_route_received_bytes_total", labels[i].c_str(), 0, routes[i].traffic_in);
+      }
+
+      AppendFamily(buffer, "webserver_route_sent_bytes_total", "counter", "Bytes of responses sent, by route.");
+      for (size_t i = 0; i < routes_count; ++i) {
+        AppendSample(buffer, "webserver_route_sent_bytes_total", labels[i].c_str(), 0, routes[i].traffic_out);
+      }
+
+      AppendFamily(buffer, "webserver_route_latency_microseconds", "summary", "Response latency percentiles of the last complete minute, by route.");
+      for (size_t i = 0; i < routes_count; ++i) {
+        const LatencyPercentiles& latency = routes[i].latency;
+        AppendSummary(buffer, "webserver_route_latency_microseconds", labels[i].c_str(), latency);
+      }
+    }
+
+    const ConnectionStats& connections = status.GetConnectionStats();
+    AppendFamily(buffer, "webserver_connections_accepted_total", "counter", "Incoming connections accepted.");
+    AppendSample(buffer, "webserver_connections_accepted_total", connections.GetAccepted());
+    AppendFamily(buffer, "webserver_connections_closed_total", "counter", "Incoming connections closed, by reason.");
+    for (size_t i = 0; i < CLOSE_REASONS_COUNT; ++i) {
+      const std::string labels = std::string("reason=\"") + CLOSE_REASON_NAMES[i] + "\"";
+      AppendSample(buffer, "webserver_connections_closed_total", labels.c_str(), 0, connections.GetClosed(static_cast<CloseReason>(i)));
+    }
+
+    AppendFamily(buffer, "webserver_accept_rate", "gauge", "Connections accepted per second, averaged over a minute.");
+    AppendSample(buffer, "webserver_accept_rate", connections.AcceptRate());
+    AppendFamily(buffer, "webserver_close_rate", "gauge", "Connections closed per second, averaged over a minute, by reason.");
+    for (size_t i = 0; i < CLOSE_REASONS_COUNT; ++i) {
+      const std::string labels = std::string("reason=\"") + CLOSE_REASON_NAMES[i] + "\"";
+      AppendSample(buffer, "webserver_close_rate", labels.c_str(), 0, connections.CloseRate(static_cast<CloseReason>(i)));
+    }
+
+    AppendFamily(buffer, "webserver_connection_requests_total", "counter", "Requests received on closed connections.");
+    AppendSample(buffer, "webserver_connection_requests_total", connections.GetRequests());
+    AppendFamily(buffer, "webserver_connection_reused_requests_total", "counter", "Requests received on connections kept alive after an earlier request.");
+    AppendSample(buffer, "webserver_connection_reused_requests_total", connections.GetReusedRequests());
+
+    const LatencyPercentiles requests_per_connection = connections.GetRequestsPerConnection();
+    AppendFamily(buffer, "webserver_connection_requests", "summary", "Requests per connection closed after a request during the last complete minute.");
+    AppendSummary(buffer, "webserver_connection_requests", 0, requests_per_connection);
+
+    const LatencyPercentiles age = connections.GetAge();
+    AppendFamily(buffer, "webserver_connection_age_milliseconds", "summary", "Age of connections closed after a request during the last complete minute.");
+    AppendSummary(buffer, "webserver_connection_age_milliseconds", 0, age);
+
+    RenderServers_(buffer);
+
+    if (const ResponseCache::sptr& cache = server.GetResponseCache()) {
+      AppendFamily(buffer, "webserver_cache_hits_total", "counter", "Requests answered from response cache.");
+      AppendSample(buffer, "webserver_cache_hits_total", cache->GetHits());
+      AppendFamily(buffer, "webserver_cache_misses_total", "counter", "Cacheable requests passed to handlers.");
+      AppendSample(buffer, "webserver_cache_misses_total", cache->GetMisses());
+      AppendFamily(buffer, "webserver_cache_memory_bytes", "gauge", "Memory held by cached responses.");
+      AppendSample(buffer, "webserver_cache_memory_bytes", cache->GetMemory());
+    }
+
+    if (const RequestCoalescer::sptr& coalescer = server.GetRequestCoalescer()) {
+      AppendFamily(buffer, "webserver_coalesced_requests_total", "counter", "Requests answered with response to identical one.");
+      AppendSample(buffer, "webserver_coalesced_requests_total", coalescer->GetCoalesced());
+    }
+
+    if (const SlowRequestLog::sptr& slow = server.GetSlowRequestLog()) {
+      AppendFamily(buffer, "webserver_slow_requests_logged_total", "counter", "Slow requests written to the slow request log.");
+      AppendSample(buffer, "webserver_slow_requests_logged_total", slow->GetLogged());
+      AppendFamily(buffer, "webserver_slow_requests_dropped_total", "counter", "Slow requests dropped while the slow request log was full.");
+      AppendSample(buffer, "webserver_slow_requests_dropped_total", slow->GetDropped());
+    }
+  }
+
+
+  void MetricsExporter::RenderServers_(std::string& buffer) const {
+    // Servers are not destroyed while they are rendered.
+    tbb::spin_mutex::scoped_lock lock(servers_mutex_);
+
+    std::vector<std::string> labels(servers_.size());
+    for (size_t i = 0; i < servers_.size(); ++i) {
+      char digits[MAX_DECIMAL_LENGTH];
+      labels[i].assign("server=\"").append(digits, FormatDecimal(servers_[i]->GetId(), digits)).append("\"");
+    }
+
+    AppendFamily(buffer, "webserver_connections", "gauge", "Open connections, by server.");
+    for (size_t i = 0; i < servers_.size(); ++i) {
+      AppendSample(buffer, "webserver_connections", labels[i].c_str(), 0, servers_[i]->ActiveConnections());
+    }
+
+    for (size_t i = 0; i < ServerStats::COUNTERS_COUNT; ++i) {
+      const ServerStats::Counter counter = static_cast<ServerStats::Counter>(i);
+      const bool is_time = counter == ServerStats::COUNTER_WAIT_TIME || counter == ServerStats::COUNTER_PERFORM_TIME ||
+                           counter == ServerStats::COUNTER_HANDLING_TIME;
+      AppendFamily(buffer, LOOP_COUNTERS[i][0], "counter", LOOP_COUNTERS[i][1]);
+
+      for (size_t j = 0; j < servers_.size(); ++j) {
+        const uint64_t value = servers_[j]->GetStats().Get(counter);
+        if (is_time) {
+          AppendSeconds(buffer, LOOP_COUNTERS[i][0], labels[j].c_str(), value);
+        }
+        else {
+          AppendSample(buffer, LOOP_COUNTERS[i][0], labels[j].c_str(), 0, value);
+        }
+      }
+    }
+
+    for (size_t i = 0; i < ServerStats::DISTRIBUTIONS_COUNT; ++i) {
+      AppendFamily(buffer, LOOP_DISTRIBUTIONS[i][0], "summary", LOOP_DISTRIBUTIONS[i][1]);
+
+      for (size_t j = 0; j < servers_.size(); ++j) {
+        const LatencyPercentiles distribution = servers_[j]->GetStats().GetPercentiles(static_cast<ServerStats::Distribution>(i));
+        AppendSummary(buffer, LOOP_DISTRIBUTIONS[i][0], labels[j].c_str(), distribution);
+      }
+    }
+  }
+
+} // namespace webserver
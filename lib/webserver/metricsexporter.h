@@ -0,0 +1,62 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_METRICS_EXPORTER_H__
+#define WEBSERVER_METRICS_EXPORTER_H__
+
+#include "incominghttpmessage.h"
+#include "outgoinghttpmessage.h"
+
+#include <base/prototype.h>
+#include <string>
+#include <tbb/spin_mutex.h>
+#include <tr1/memory>
+#include <vector>
+
+
+namespace webserver {
+
+  class Server;
+
+  //
+  // Prometheus endpoint.
+  //
+  // Connections answer GET and HEAD requests for the metrics URI on server's thread, scrapes
+  // never wait in handler's queue behind the traffic they are supposed to watch. Metrics of
+  // WebserverStatus and of server's response cache and coalescer are rendered in text
+  // exposition format into a buffer kept by every server thread.
+  //
+  // Event loop metrics are rendered for every server exporter is given to, labeled with
+  // server's id, so scrapes answered by any server see all of them.
+  //
+
+  class MetricsExporter : public base::NonCopyable {
+  public:
+    typedef std::tr1::shared_ptr<MetricsExporter> sptr;
+
+    explicit MetricsExporter(const std::string& uri = "/metrics");
+
+    const std::string& GetUri() const;
+    // Returns true for GET and HEAD requests of metrics URI, query is ignored.
+    bool IsScrape(const IncomingHttpMessage& request) const;
+    OutgoingHttpMessage::sptr Serve(const IncomingHttpMessage::sptr& request, const Server& server) const;
+
+    // Replaces buffer contents with metrics.
+    void Render(const Server& server, std::string& buffer) const;
+
+    // Called by servers as they are given the exporter and destroyed.
+    void Attach(const Server& server);
+    void Detach(const Server& server);
+
+  private:
+    void RenderServers_(std::string& buffer) const;
+
+    const std::string uri_;
+    mutable tbb::spin_mutex servers_mutex_;
+    std::vector<const Server*> servers_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_METRICS_EXPORTER_H__
@@ -0,0 +1,95 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "notifier.h"
+
+#include <cerrno>
+
+extern "C" {
+#include <fcntl.h>
+#include <unistd.h>
+}
+
+
+namespace webserver {
+
+  Notifier::Notifier()
+  : write_fd_(-1)
+  , poll_(0) {
+    notified_ = false;
+  }
+
+
+  Notifier::~Notifier() {
+    Close();
+  }
+
+
+  bool Notifier::Open(io::Poll* poll) {
+    int fds[2];
+    if (::pipe(fds) != 0) {
+      return false;
+    }
+
+    for (int i = 0; i < 2; ++i) {
+      if (::fcntl(fds[i], F_SETFL, ::fcntl(fds[i], F_GETFL) | O_NONBLOCK) != 0) {
+        ::close(fds[0]);
+        ::close(fds[1]);
+        return false;
+      }
+    }
+
+    fd_ = fds[0];
+    write_fd_ = fds[1];
+    poll_ = poll;
+
+    SetState(STATE_CONNECTED);
+    poll_->Open(this);
+    poll_->InsertRead(this);
+    return true;
+  }
+
+
+  void Notifier::Close() {
+    if (fd_ == -1) {
+      return;
+    }
+
+    SetState(STATE_CLOSING);
+    poll_->RemoveRead(this);
+    poll_->Close(this);
+
+    ::close(fd_);
+    ::close(write_fd_);
+    fd_ = -1;
+    write_fd_ = -1;
+  }
+
+
+  void Notifier::Notify() {
+    if (write_fd_ == -1 || notified_.compare_and_swap(true, false)) {
+      return;
+    }
+
+    const char c = 0;
+    while (::write(write_fd_, &c, 1) < 0 && errno == EINTR) { }
+  }
+
+
+  void Notifier::EventRead() {
+    char buffer[64];
+    while (::read(fd_, buffer, sizeof(buffer)) > 0) { }
+
+    // Cleared after draining, so byte of a notification coming meanwhile is never drained
+    // with the flag left set. Posted work is delivered after each poll anyway.
+    notified_ = false;
+  }
+
+
+  void Notifier::EventWrite() { }
+
+
+  void Notifier::EventError() { }
+
+} // namespace webserver
@@ -0,0 +1,39 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_NOTIFIER_H__
+#define WEBSERVER_NOTIFIER_H__
+
+#include <io/event.h>
+#include <io/poll.h>
+#include <tbb/atomic.h>
+
+
+namespace webserver {
+
+  // Self-pipe, which wakes server's poll up when work is posted from other threads.
+  class Notifier : public io::Event {
+  public:
+    Notifier();
+    ~Notifier();
+
+    bool Open(io::Poll* poll);
+    void Close();
+
+    // May be called from any thread, repeated notifications are coalesced.
+    void Notify();
+
+    void EventRead();
+    void EventWrite();
+    void EventError();
+
+  private:
+    int write_fd_;
+    io::Poll* poll_;
+    tbb::atomic<bool> notified_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_NOTIFIER_H__
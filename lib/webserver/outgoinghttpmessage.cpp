@@ -3,73 +3,207 @@
 // Copyright 2010 LibWebserver Authors. All rights reserved.
 
 #include "outgoinghttpmessage.h"
-#include <base/string_helpers.h>
+#include "commonheaders.h"
+#include "compressor.h"
+#include "incominghttpmessage.h"
+#include <cstring>
+
+extern "C" {
+#include <strings.h>
+}
 
 
 namespace webserver {
 
-  tbb::atomic<size_t> OutgoingHttpMessage::header_reservation_;
+  namespace {
+    const char KEEP_ALIVE_LINE[] = "Connection: keep-alive\r\n";
+    const char CLOSE_LINE[] = "Connection: close\r\n";
+    // Headers which belong to a single request or connection and are left out of shared bytes.
+    const char* const PER_REQUEST_HEADERS[] = { "connection:", "x-request-id:" };
+    const size_t PER_REQUEST_HEADERS_COUNT = sizeof(PER_REQUEST_HEADERS) / sizeof(PER_REQUEST_HEADERS[0]);
+
+
+    bool IsPerRequestHeader(const char* line, const size_t length) {
+      for (size_t i = 0; i < PER_REQUEST_HEADERS_COUNT; ++i) {
+        const size_t name_length = ::strlen(PER_REQUEST_HEADERS[i]);
+        if (length >= name_length && ::strncasecmp(line, PER_REQUEST_HEADERS[i], name_length) == 0) {
+          return true;
+        }
+      }
+      return false;
+    }
+
+
+    // Copies header lines but the Connection one into buffer, or only measures them when
+    // buffer is null. Returns length of the lines.
+    size_t CopyWithoutConnection(const HeaderBuilder& header, char* buffer) {
+      size_t length = 0;
+      const char* line = header.Data();
+      const char* const end = line + header.Length();
+      while (line < end) {
+        const char* line_end = static_cast<const char*>(::memchr(line, '\n', end - line));
+        line_end = line_end ? line_end + 1 : end;
+
+        if (line_end - line < 11 || ::strncasecmp(line, "connection:", 11) != 0) {
+          if (buffer) {
+            ::memcpy(buffer + length, line, line_end - line);
+          }
+          length += line_end - line;
+        }
+        line = line_end;
+      }
+      return length;
+    }
+  }
+
 
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::bad_request_ = OutgoingHttpMessage::Prebuild_(HTTP_BAD_REQUEST, false);
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::forbidden_ = OutgoingHttpMessage::Prebuild_(HTTP_FORBIDDEN, false);
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::not_found_ = OutgoingHttpMessage::Prebuild_(HTTP_NOT_FOUND, false);
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::not_found_persistent_ = OutgoingHttpMessage::Prebuild_(HTTP_NOT_FOUND, true);
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::entity_too_large_ = OutgoingHttpMessage::Prebuild_(HTTP_ENTITY_TOO_LARGE, false);
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::too_many_connections_ = OutgoingHttpMessage::Prebuild_(HTTP_TOO_MANY_CONNECTIONS, false);
 
-  OutgoingHttpMessage::OutgoingHttpMessage(const clocks::HiResTimer* timer)
+
+  OutgoingHttpMessage::OutgoingHttpMessage(const clocks::Timestamp* timer)
   : method_(webserver::RESPONSE)
   , response_code_(webserver::HTTP_OK)
-  , data_len_(0)
-  , len_(0)
   , data_(0)
+  , data_len_(0)
+  , is_head_only_(false)
+  , is_chunked_(false)
+  , is_close_delimited_(false)
   , message_(0)
-  , timer_(0) {
-    header_.reserve(header_reservation_);
+  , message_len_(0)
+  , body_len_(0)
+  , prebuilt_status_len_(0)
+  , prebuilt_header_len_(0)
+  , connection_line_(0)
+  , connection_line_len_(0)
+  , is_immutable_(false) {
     if (timer) {
-      timer_ = (new clocks::HiResTimer(*timer));
+      SetTimer(*timer);
     }
   }
 
 
-  OutgoingHttpMessage::OutgoingHttpMessage(const clocks::HiResTimer& timer)
+  OutgoingHttpMessage::OutgoingHttpMessage(const clocks::Timestamp& timer)
   : method_(webserver::RESPONSE)
   , response_code_(webserver::HTTP_OK)
-  , data_len_(0)
-  , len_(0)
   , data_(0)
+  , data_len_(0)
+  , is_head_only_(false)
+  , is_chunked_(false)
+  , is_close_delimited_(false)
   , message_(0)
-  , timer_(new clocks::HiResTimer(timer)) {
-    header_.reserve(header_reservation_);
+  , message_len_(0)
+  , body_len_(0)
+  , prebuilt_status_len_(0)
+  , prebuilt_header_len_(0)
+  , connection_line_(0)
+  , connection_line_len_(0)
+  , is_immutable_(false) {
+    SetTimer(timer);
   }
 
 
   OutgoingHttpMessage::OutgoingHttpMessage()
   : method_(webserver::RESPONSE)
   , response_code_(webserver::HTTP_OK)
-  , data_len_(0)
-  , len_(0)
   , data_(0)
+  , data_len_(0)
+  , is_head_only_(false)
+  , is_chunked_(false)
+  , is_close_delimited_(false)
   , message_(0)
-  , timer_(0) {
-    header_.reserve(header_reservation_);
+  , message_len_(0)
+  , body_len_(0)
+  , prebuilt_status_len_(0)
+  , prebuilt_header_len_(0)
+  , connection_line_(0)
+  , connection_line_len_(0)
+  , is_immutable_(false) {
   }
 
 
-  OutgoingHttpMessage::~OutgoingHttpMessage() {
-    if (timer_) {
-      delete timer_;
+  OutgoingHttpMessage::OutgoingHttpMessage(const sptr& canonical, const clocks::Timestamp* timer)
+  : method_(webserver::RESPONSE)
+  , response_code_(canonical->response_code_)
+  , data_(canonical->data_)
+  , data_len_(canonical->data_len_)
+  , shared_data_(canonical->shared_data_)
+  , is_head_only_(false)
+  , is_chunked_(false)
+  , is_close_delimited_(false)
+  , message_(0)
+  , message_len_(0)
+  , body_len_(canonical->data_len_)
+  , prebuilt_status_len_(canonical->prebuilt_status_len_)
+  , prebuilt_header_len_(canonical->prebuilt_header_len_)
+  , connection_line_(canonical->connection_line_)
+  , connection_line_len_(canonical->connection_line_len_)
+  , is_immutable_(false) {
+    OutgoingMessage::SetPersistence(canonical->IsPersistent());
+    if (timer) {
+      SetTimer(*timer);
     }
+  }
+
 
+  OutgoingHttpMessage::~OutgoingHttpMessage() {
     if (message_) {
       delete[] message_;
     }
-
-    if (data_) {
-      delete[] data_;
-    }
   }
 
 
   void OutgoingHttpMessage::Serialize() {
+    if (prebuilt_header_len_ != 0) {
+      return;
+    }
+
+    // Framing header is formatted on the stack and the whole message is written into a
+    // single buffer of exact length.
+    const char* framing = 0;
+    size_t framing_len = 0;
+    char length[MAX_DECIMAL_LENGTH];
+    size_t length_len = 0;
+
+    if (method_ == POST) {
+      framing = "Content-Length: ";
+      framing_len = 16;
+      length_len = FormatDecimal(data_len_, length);
+    }
+    else if (method_ == RESPONSE) {
+      if (is_close_delimited_) {
+        // Body ends with the connection, which replaces whatever Connection line was added.
+        framing = "Connection: close";
+        framing_len = 17;
+      }
+      else if (is_chunked_) {
+        framing = "Transfer-Encoding: chunked";
+        framing_len = 26;
+      }
+      else if (response_code_ == HTTP_OK && data_len_ == 0) {
+        response_code_ = HTTP_NO_CONTENT;
+      }
+      // Not modified response has no body, and length of the body it stands for is unknown here.
+      else if (response_code_ != HTTP_NOT_MODIFIED) {
+        framing = "Content-Length: ";
+        framing_len = 16;
+        length_len = FormatDecimal(data_len_, length);
+      }
+    }
+
+    const size_t framing_line_len = framing ? framing_len + length_len + 2 : 0;
+    const size_t header_len = is_close_delimited_ ? CopyWithoutConnection(header_, 0) : header_.Length();
     size_t pos = 0;
+
     if (method_ == GET) {
-      len_ = uri_.length() + header_.length() + data_len_ + 19;
-      message_ = new char[len_];
+      // Data is sent as the query string, so it is a part of the request line.
+      message_len_ = uri_.length() + header_len + data_len_ + 18;
+      body_len_ = 0;
+      message_ = new char[message_len_ + 1];
 
       ::memcpy(message_, "GET ", 4);
       pos += 4;
@@ -81,80 +215,136 @@ namespace webserver {
       pos += data_len_;
       ::memcpy(message_ + pos, " HTTP/1.1\r\n", 11);
       pos += 11;
-      ::memcpy(message_ + pos, header_.c_str(), header_.length());
-      pos += header_.length();
-      ::memcpy(message_ + pos, "\r\n", 2);
-      pos += 2;
     }
     else if (method_ == POST) {
-      header_.append("Content-Length: ");
-      header_.append(base::ToString(data_len_));
-      header_.append("\r\n");
+      message_len_ = uri_.length() + header_len + framing_line_len + 18;
+      body_len_ = file_data_ ? 0 : data_len_;
+      message_ = new char[message_len_ + 1];
 
-      len_ = uri_.length() + header_.length() + data_len_ + 19;
-      message_ = new char[len_];
       ::memcpy(message_, "POST ", 5);
       pos += 5;
       ::memcpy(message_ + pos, uri_.c_str(), uri_.length());
       pos += uri_.length();
       ::memcpy(message_ + pos, " HTTP/1.1\r\n", 11);
       pos += 11;
-      ::memcpy(message_ + pos, header_.c_str(), header_.length());
-      pos += header_.length();
-      ::memcpy(message_ + pos, "\r\n", 2);
-      pos += 2;
-      ::memcpy(message_ + pos, data_, data_len_);
-      pos += data_len_;
     }
     // method_ == RESPONSE
     else {
-      if (response_code_ == HTTP_OK && data_len_ == 0) {
-        response_code_ = HTTP_NO_CONTENT;
-      }
-      else {
-        header_.append("Content-Length: ");
-        header_.append(base::ToString(data_len_));
-        header_.append("\r\n");
-      }
+      message_len_ = HTTP_CODES_LENGTH[response_code_] + CommonHeaders::Length() + header_len + framing_line_len + 13;
+      body_len_ = is_head_only_ || file_data_ || response_code_ == HTTP_NOT_MODIFIED ? 0 : data_len_;
+      message_ = new char[message_len_ + 1];
 
-      len_ = HTTP_CODES_LENGTH[response_code_] + header_.length() + data_len_ + 14;
-      message_ = new char[len_];
       ::memcpy(message_, "HTTP/1.1 ", 9);
       pos += 9;
       ::memcpy(message_ + pos, HTTP_CODES[response_code_][HTTP_MESSAGE], HTTP_CODES_LENGTH[response_code_]);
       pos += HTTP_CODES_LENGTH[response_code_];
       ::memcpy(message_ + pos, "\r\n", 2);
       pos += 2;
-      ::memcpy(message_ + pos, header_.c_str(), header_.length());
-      pos += header_.length();
+      pos += CommonHeaders::Copy(message_ + pos);
+    }
+
+    if (is_close_delimited_) {
+      CopyWithoutConnection(header_, message_ + pos);
+    }
+    else {
+      ::memcpy(message_ + pos, header_.Data(), header_len);
+    }
+    pos += header_len;
+
+    if (framing) {
+      ::memcpy(message_ + pos, framing, framing_len);
+      pos += framing_len;
+      ::memcpy(message_ + pos, length, length_len);
+      pos += length_len;
       ::memcpy(message_ + pos, "\r\n", 2);
       pos += 2;
-      ::memcpy(message_ + pos, data_, data_len_);
-      pos += data_len_;
     }
 
+    ::memcpy(message_ + pos, "\r\n", 2);
+    pos += 2;
     message_[pos] = 0;
-    UpdateReservation_(header_.length());
   }
 
 
-  const char* OutgoingHttpMessage::GetSerializedMessage() const {
-    return message_;
+  size_t OutgoingHttpMessage::GetSegments(const size_t offset, iovec* segments, const size_t count) const {
+    iovec pieces[5];
+    size_t pieces_count = 0;
+
+    if (prebuilt_header_len_ != 0) {
+      // Shared bytes lack common headers, they are sent right after the status line. Date
+      // line has fixed length, so the message stays intact even if the line is replaced
+      // while it is being written.
+      const std::string& common = CommonHeaders::GetStatic();
+      pieces[0].iov_base = const_cast<char*>(data_);
+      pieces[0].iov_len = prebuilt_status_len_;
+      pieces[1].iov_base = const_cast<char*>(CommonHeaders::GetDate());
+      pieces[1].iov_len = CommonHeaders::DATE_LENGTH;
+      pieces[2].iov_base = const_cast<char*>(common.data());
+      pieces[2].iov_len = common.length();
+      pieces_count = 3;
+
+      if (connection_line_len_ != 0) {
+        pieces[pieces_count].iov_base = const_cast<char*>(connection_line_);
+        pieces[pieces_count].iov_len = connection_line_len_;
+        ++pieces_count;
+      }
+
+      pieces[pieces_count].iov_base = const_cast<char*>(data_ + prebuilt_status_len_);
+      pieces[pieces_count].iov_len = body_len_ - prebuilt_status_len_;
+      ++pieces_count;
+    }
+    else {
+      pieces[0].iov_base = message_;
+      pieces[0].iov_len = message_len_;
+      pieces[1].iov_base = const_cast<char*>(data_);
+      pieces[1].iov_len = body_len_;
+      pieces_count = 2;
+    }
+
+    size_t skip = offset;
+    size_t n = 0;
+    for (size_t i = 0; i < pieces_count && n < count; ++i) {
+      if (skip >= pieces[i].iov_len) {
+        skip -= pieces[i].iov_len;
+        continue;
+      }
+
+      segments[n].iov_base = static_cast<char*>(pieces[i].iov_base) + skip;
+      segments[n].iov_len = pieces[i].iov_len - skip;
+      skip = 0;
+      ++n;
+    }
+
+    return n;
+  }
+
+
+  const FileBody* OutgoingHttpMessage::GetFileBody() const {
+    if (!file_data_ || is_head_only_ || method_ == GET || response_code_ == HTTP_NOT_MODIFIED) {
+      return 0;
+    }
+
+    return file_data_.get();
   }
 
 
   size_t OutgoingHttpMessage::GetLength() const {
-    return len_ - 1;
+    if (prebuilt_header_len_ != 0) {
+      return body_len_ + CommonHeaders::Length() + connection_line_len_;
+    }
+
+    const FileBody* file = GetFileBody();
+    return message_len_ + body_len_ + (file ? file->Length() : 0);
   }
 
 
   void OutgoingHttpMessage::SetPersistence(const bool is_persistent) {
     OutgoingMessage::SetPersistence(is_persistent);
     if (is_persistent) {
-      header_.append("Connection: keep-alive\r\n");
+      header_.Append(KEEP_ALIVE_LINE, sizeof(KEEP_ALIVE_LINE) - 1);
     }
     else {
-      header_.append("Connection: close\r\n");
+      header_.Append(CLOSE_LINE, sizeof(CLOSE_LINE) - 1);
     }
   }
 
@@ -175,33 +365,232 @@ namespace webserver {
 
 
   void OutgoingHttpMessage::AddHeader(const char* key, const char* value) {
-    header_.append(key);
-    header_.append(": ");
-    header_.append(value);
-    header_.append("\r\n");
+    header_.AppendLine(key, value);
+  }
+
+
+  void OutgoingHttpMessage::AddHeaders(const std::string& lines) {
+    header_.Append(lines);
+  }
+
+
+  bool OutgoingHttpMessage::FindHeader(const char* key, std::string& value) const {
+    return header_.Find(key, value);
   }
 
 
   void OutgoingHttpMessage::SetData(const char* data, const size_t len) {
-    data_ = new char[len];
-    ::memcpy(data_, data, len);
+    // Body of head-only message is kept as well, Compress() needs it for the encoded length.
+    owned_data_.assign(data, len);
+    SetBorrowedData(owned_data_.data(), len);
+  }
+
+
+  void OutgoingHttpMessage::SetData(const Blob::sptr& data) {
+    shared_data_ = data;
+    SetBorrowedData(data->Data(), data->Length());
+  }
+
+
+  void OutgoingHttpMessage::SetData(const FileBody::sptr& data) {
+    SetBorrowedData(0, data->Length());
+    file_data_ = data;
+  }
+
+
+  void OutgoingHttpMessage::SwapData(std::string& data) {
+    owned_data_.swap(data);
+    SetBorrowedData(owned_data_.data(), owned_data_.length());
+  }
+
+
+  void OutgoingHttpMessage::SetBorrowedData(const char* data, const size_t len) {
+    file_data_.reset();
+    data_ = data;
     data_len_ = len;
   }
 
 
-  clocks::HiResTimer* OutgoingHttpMessage::GetTimer() const {
-    return timer_;
+  bool OutgoingHttpMessage::Compress(const IncomingHttpMessage& request) {
+    if (method_ != RESPONSE || response_code_ != HTTP_OK || is_immutable_ || is_chunked_ || file_data_ ||
+        message_ || !data_ || data_len_ < Compressor::GetMinLength()) {
+      return false;
+    }
+
+    std::string value;
+    if (!header_.Find("content-type", value) || !Compressor::IsCompressible(value) ||
+        header_.Find("content-encoding", value)) {
+      return false;
+    }
+
+    // Caches must keep variants apart even if this client gets the body as it is.
+    header_.Append("Vary: Accept-Encoding\r\n", 23);
+
+    // Response to HEAD is compressed as well, so its header matches the one GET would get.
+    const Compressor::Coding coding = Compressor::Negotiate(request);
+    if (coding == Compressor::IDENTITY) {
+      return false;
+    }
+
+    const Blob::sptr compressed = Compressor::Compress(coding, data_, data_len_);
+    if (!compressed) {
+      return false;
+    }
+
+    AddHeader("Content-Encoding", Compressor::GetName(coding));
+    std::string().swap(owned_data_);
+    SetData(compressed);
+    return true;
+  }
+
+
+  void OutgoingHttpMessage::SetHeadOnly(const bool is_head_only) {
+    is_head_only_ = is_head_only;
+
+    if (prebuilt_header_len_ != 0) {
+      body_len_ = is_head_only_ ? prebuilt_header_len_ : data_len_;
+    }
+  }
+
+
+  bool OutgoingHttpMessage::IsHeadOnly() const {
+    return is_head_only_;
+  }
+
+
+  void OutgoingHttpMessage::SetCloseDelimited() {
+    if (!is_chunked_) {
+      return;
+    }
+
+    is_close_delimited_ = true;
+    OutgoingMessage::SetPersistence(false);
+  }
+
+
+  bool OutgoingHttpMessage::IsCloseDelimited() const {
+    return is_close_delimited_;
+  }
+
+
+  void OutgoingHttpMessage::SetChunked_() {
+    is_chunked_ = true;
+  }
+
+
+  bool OutgoingHttpMessage::IsImmutable() const {
+    return is_immutable_;
+  }
+
+
+  const OutgoingHttpMessage::sptr& OutgoingHttpMessage::GetHeadOnlyTwin() const {
+    return head_only_twin_;
+  }
+
+
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::Share() const {
+    if (method_ != RESPONSE || prebuilt_header_len_ != 0 || message_ || is_head_only_ || is_chunked_ || file_data_) {
+      return sptr();
+    }
+
+    const HttpCode code = response_code_ == HTTP_OK && data_len_ == 0 ? HTTP_NO_CONTENT : response_code_;
+    std::string serialized("HTTP/1.1 ");
+    serialized.append(HTTP_CODES[code][HTTP_MESSAGE], HTTP_CODES_LENGTH[code]);
+    serialized.append("\r\n");
+    const size_t status_len = serialized.length();
+
+    // Connection line is chosen by each message sending the shared bytes, request id is the
+    // one of the first requester only.
+    const char* line = header_.Data();
+    const char* const end = line + header_.Length();
+    while (line < end) {
+      const char* line_end = static_cast<const char*>(::memchr(line, '\n', end - line));
+      line_end = line_end ? line_end + 1 : end;
+
+      if (!IsPerRequestHeader(line, line_end - line)) {
+        serialized.append(line, line_end - line);
+      }
+      line = line_end;
+    }
+
+    if (code != HTTP_NO_CONTENT && code != HTTP_NOT_MODIFIED) {
+      char length[MAX_DECIMAL_LENGTH];
+      serialized.append("Content-Length: ");
+      serialized.append(length, FormatDecimal(data_len_, length));
+      serialized.append("\r\n");
+    }
+
+    serialized.append("\r\n");
+    const size_t header_len = serialized.length();
+    if (code != HTTP_NOT_MODIFIED) {
+      serialized.append(data_, data_len_);
+    }
+
+    sptr shared = sptr(new OutgoingHttpMessage());
+    shared->SetResponseCode(code);
+    shared->SetData(Blob::Create(serialized));
+    shared->body_len_ = shared->data_len_;
+    shared->prebuilt_status_len_ = status_len;
+    shared->prebuilt_header_len_ = header_len;
+
+    shared->head_only_twin_ = sptr(new OutgoingHttpMessage(shared, 0));
+    shared->head_only_twin_->SetHeadOnly(true);
+    shared->head_only_twin_->is_immutable_ = true;
+    shared->is_immutable_ = true;
+    return shared;
   }
 
 
-  void OutgoingHttpMessage::UpdateReservation_(const size_t length) {
-    if (length > header_reservation_) {
-      header_reservation_ = length;
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::Prebuild_(const HttpCode code, const bool is_persistent) {
+    // Common headers may be not set up yet, they are inserted when the message is sent.
+    std::string serialized("HTTP/1.1 ");
+    serialized.append(HTTP_CODES[code][HTTP_MESSAGE], HTTP_CODES_LENGTH[code]);
+    serialized.append("\r\n");
+    const size_t status_len = serialized.length();
+
+    serialized.append(is_persistent ? KEEP_ALIVE_LINE : CLOSE_LINE);
+    char length[MAX_DECIMAL_LENGTH];
+    serialized.append("Content-Length: ");
+    serialized.append(length, FormatDecimal(HTTP_CODES_LENGTH[code], length));
+    serialized.append("\r\n\r\n");
+    const size_t header_len = serialized.length();
+    serialized.append(HTTP_CODES[code][HTTP_MESSAGE], HTTP_CODES_LENGTH[code]);
+
+    sptr canonical = sptr(new OutgoingHttpMessage());
+    canonical->SetResponseCode(code);
+    canonical->OutgoingMessage::SetPersistence(is_persistent);
+    canonical->SetData(Blob::Create(serialized));
+    canonical->body_len_ = canonical->data_len_;
+    canonical->prebuilt_status_len_ = status_len;
+    canonical->prebuilt_header_len_ = header_len;
+
+    canonical->head_only_twin_ = sptr(new OutgoingHttpMessage(canonical, 0));
+    canonical->head_only_twin_->SetHeadOnly(true);
+    canonical->head_only_twin_->is_immutable_ = true;
+    canonical->is_immutable_ = true;
+    return canonical;
+  }
+
+
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::Prebuilt_(const sptr& canonical, const clocks::Timestamp* timer) {
+    if (!timer) {
+      return canonical;
     }
+
+    return sptr(new OutgoingHttpMessage(canonical, timer));
+  }
+
+
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::Reuse(const sptr& shared, const bool is_persistent, const clocks::Timestamp* t) {
+    sptr response = sptr(new OutgoingHttpMessage(shared, t));
+    response->OutgoingMessage::SetPersistence(is_persistent);
+    response->connection_line_ = is_persistent ? KEEP_ALIVE_LINE : CLOSE_LINE;
+    response->connection_line_len_ = is_persistent ? sizeof(KEEP_ALIVE_LINE) - 1 : sizeof(CLOSE_LINE) - 1;
+    return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::OK(const std::string& request_id, const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::OK(const std::string& request_id, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_OK);
@@ -211,12 +600,12 @@ namespace webserver {
       response->AddHeader("X-Request-Id", request_id.c_str());
     }
 
-    response->SetData(HTTP_CODES[HTTP_OK][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_OK]);
+    response->SetBorrowedData(HTTP_CODES[HTTP_OK][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_OK]);
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NoContent(const std::string& request_id, const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NoContent(const std::string& request_id, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_NO_CONTENT);
@@ -226,21 +615,17 @@ namespace webserver {
       response->AddHeader("X-Request-Id", request_id.c_str());
     }
 
-    response->SetData(HTTP_CODES[HTTP_NO_CONTENT][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NO_CONTENT]);
+    response->SetBorrowedData(HTTP_CODES[HTTP_NO_CONTENT][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NO_CONTENT]);
     return response;
   }
 
 
   OutgoingHttpMessage::sptr OutgoingHttpMessage::BadRequest() {
-    sptr response = sptr(new OutgoingHttpMessage());
-    response->SetMethod(RESPONSE);
-    response->SetResponseCode(HTTP_BAD_REQUEST);
-    response->SetPersistence(false);
-    response->SetData(HTTP_CODES[HTTP_BAD_REQUEST][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_BAD_REQUEST]);
-    return response;
+    return bad_request_;
   }
 
 
+
   OutgoingHttpMessage::sptr OutgoingHttpMessage::BadRequest(const std::string& request_id) {
     sptr response = sptr(new OutgoingHttpMessage());
     response->SetMethod(RESPONSE);
@@ -251,22 +636,18 @@ namespace webserver {
         response->AddHeader("X-Request-Id", request_id.c_str());
       }
 
-    response->SetData(HTTP_CODES[HTTP_BAD_REQUEST][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_BAD_REQUEST]);
+    response->SetBorrowedData(HTTP_CODES[HTTP_BAD_REQUEST][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_BAD_REQUEST]);
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::Forbidden(const clocks::HiResTimer* t) {
-    sptr response = sptr(new OutgoingHttpMessage(t));
-    response->SetMethod(RESPONSE);
-    response->SetResponseCode(HTTP_FORBIDDEN);
-    response->SetPersistence(false);
-    response->SetData(HTTP_CODES[HTTP_FORBIDDEN][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_FORBIDDEN]);
-    return response;
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::Forbidden(const clocks::Timestamp* t) {
+    return Prebuilt_(forbidden_, t);
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::Forbidden(const std::string& request_id, const clocks::HiResTimer* t) {
+
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::Forbidden(const std::string& request_id, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_FORBIDDEN);
@@ -276,22 +657,18 @@ namespace webserver {
       response->AddHeader("X-Request-Id", request_id.c_str());
     }
 
-    response->SetData(HTTP_CODES[HTTP_FORBIDDEN][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_FORBIDDEN]);
+    response->SetBorrowedData(HTTP_CODES[HTTP_FORBIDDEN][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_FORBIDDEN]);
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotFound(const bool is_persistent, const clocks::HiResTimer* t) {
-    sptr response = sptr(new OutgoingHttpMessage(t));
-    response->SetMethod(RESPONSE);
-    response->SetResponseCode(HTTP_NOT_FOUND);
-    response->SetPersistence(is_persistent);
-    response->SetData(HTTP_CODES[HTTP_NOT_FOUND][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_FOUND]);
-    return response;
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotFound(const bool is_persistent, const clocks::Timestamp* t) {
+    return Prebuilt_(is_persistent ? not_found_persistent_ : not_found_, t);
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotFound(const std::string& content, const bool is_persistent, const clocks::HiResTimer* t) {
+
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotFound(const std::string& content, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_NOT_FOUND);
@@ -301,14 +678,14 @@ namespace webserver {
       response->SetData(content.c_str(), content.length());
     }
     else {
-      response->SetData(HTTP_CODES[HTTP_NOT_FOUND][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_FOUND]);
+      response->SetBorrowedData(HTTP_CODES[HTTP_NOT_FOUND][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_FOUND]);
     }
 
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotFound(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotFound(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_NOT_FOUND);
@@ -322,24 +699,24 @@ namespace webserver {
       response->SetData(content.c_str(), content.length());
     }
     else {
-      response->SetData(HTTP_CODES[HTTP_NOT_FOUND][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_FOUND]);
+      response->SetBorrowedData(HTTP_CODES[HTTP_NOT_FOUND][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_FOUND]);
     }
 
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotAcceptable(const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotAcceptable(const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_NOT_ACCEPTABLE);
     response->SetPersistence(is_persistent);
-    response->SetData(HTTP_CODES[HTTP_NOT_ACCEPTABLE][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_ACCEPTABLE]);
+    response->SetBorrowedData(HTTP_CODES[HTTP_NOT_ACCEPTABLE][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_ACCEPTABLE]);
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotAcceptable(const std::string& content, const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotAcceptable(const std::string& content, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_NOT_ACCEPTABLE);
@@ -349,14 +726,14 @@ namespace webserver {
       response->SetData(content.c_str(), content.length());
     }
     else {
-      response->SetData(HTTP_CODES[HTTP_NOT_ACCEPTABLE][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_ACCEPTABLE]);
+      response->SetBorrowedData(HTTP_CODES[HTTP_NOT_ACCEPTABLE][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_ACCEPTABLE]);
     }
 
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotAcceptable(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::NotAcceptable(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_NOT_ACCEPTABLE);
@@ -370,14 +747,14 @@ namespace webserver {
       response->SetData(content.c_str(), content.length());
     }
     else {
-      response->SetData(HTTP_CODES[HTTP_NOT_ACCEPTABLE][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_ACCEPTABLE]);
+      response->SetBorrowedData(HTTP_CODES[HTTP_NOT_ACCEPTABLE][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_NOT_ACCEPTABLE]);
     }
 
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::RequestTimeout(const std::string& request_id, const bool is_persistent, const clocks::HiResTimer* t) {
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::RequestTimeout(const std::string& request_id, const bool is_persistent, const clocks::Timestamp* t) {
     sptr response = sptr(new OutgoingHttpMessage(t));
     response->SetMethod(RESPONSE);
     response->SetResponseCode(HTTP_TIMEOUT);
@@ -387,19 +764,19 @@ namespace webserver {
       response->AddHeader("X-Request-Id", request_id.c_str());
     }
 
-    response->SetData(HTTP_CODES[HTTP_TIMEOUT][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_TIMEOUT]);
+    response->SetBorrowedData(HTTP_CODES[HTTP_TIMEOUT][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_TIMEOUT]);
     return response;
   }
 
 
-  OutgoingHttpMessage::sptr OutgoingHttpMessage::TooManyConnections(const clocks::HiResTimer* t) {
-    sptr response = sptr(new OutgoingHttpMessage(t));
-    response->SetMethod(RESPONSE);
-    response->SetResponseCode(HTTP_TOO_MANY_CONNECTIONS);
-    response->SetPersistence(false);
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::EntityTooLarge(const clocks::Timestamp* t) {
+    return Prebuilt_(entity_too_large_, t);
+  }
 
-    response->SetData(HTTP_CODES[HTTP_TOO_MANY_CONNECTIONS][HTTP_MESSAGE], HTTP_CODES_LENGTH[HTTP_TOO_MANY_CONNECTIONS]);
-    return response;
+
+  OutgoingHttpMessage::sptr OutgoingHttpMessage::TooManyConnections(const clocks::Timestamp* t) {
+    return Prebuilt_(too_many_connections_, t);
   }
 
+
 } // namespace webserver
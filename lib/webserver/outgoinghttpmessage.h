@@ -5,24 +5,30 @@
 #ifndef WEBSERVER_OUTGOING_HTTP_MESSAGE_H__
 #define WEBSERVER_OUTGOING_HTTP_MESSAGE_H__
 
+#include "blob.h"
+#include "filebody.h"
+#include "headerbuilder.h"
 #include "httptypes.h"
 #include "message.h"
-#include <tbb/atomic.h>
+#include <string>
 
 
 namespace webserver {
 
+  class IncomingHttpMessage;
+
   class OutgoingHttpMessage : public OutgoingMessage {
   public:
     typedef std::tr1::shared_ptr<OutgoingHttpMessage> sptr;
 
-    OutgoingHttpMessage(const clocks::HiResTimer* timer);
-    OutgoingHttpMessage(const clocks::HiResTimer& timer);
+    OutgoingHttpMessage(const clocks::Timestamp* timer);
+    OutgoingHttpMessage(const clocks::Timestamp& timer);
     OutgoingHttpMessage();
     ~OutgoingHttpMessage();
 
     void Serialize();
-    const char* GetSerializedMessage() const;
+    size_t GetSegments(const size_t offset, iovec* segments, const size_t count) const;
+    const FileBody* GetFileBody() const;
     size_t GetLength() const;
 
     void SetPersistence(const bool is_persistent);
@@ -30,41 +36,109 @@ namespace webserver {
     void SetResponseCode(const HttpCode code);
     void SetMethod(const HttpMethod method);
     void AddHeader(const char* key, const char* value);
+    // Appends preformatted header lines, each one terminated by CRLF.
+    void AddHeaders(const std::string& lines);
+    // Value of a header added to the message, key is compared case-insensitively.
+    bool FindHeader(const char* key, std::string& value) const;
+    // Body sources. Body is never copied into the serialized message, it is written to
+    // the socket straight from where it is kept.
+    //
+    // Copies data into the message.
     void SetData(const char* data, const size_t len);
-    clocks::HiResTimer* GetTimer() const;
+    // Shares immutable blob with other messages.
+    void SetData(const Blob::sptr& data);
+    // Sends range of a file, not for GET requests.
+    void SetData(const FileBody::sptr& data);
+    // Takes contents of data, leaving it empty.
+    void SwapData(std::string& data);
+    // Refers to data which must stay unchanged until the message is written or destroyed,
+    // e.g. static strings.
+    void SetBorrowedData(const char* data, const size_t len);
+    // Compresses body with coding accepted by the request, if body is long enough and its
+    // Content-Type is compressible, see Compressor. Called by handler before sending and
+    // before SetHeadOnly(): response to HEAD is compressed as well, so its header is the
+    // one GET would get.
+    bool Compress(const IncomingHttpMessage& request);
+    // Response to HEAD request: body is neither copied nor serialized, only its length is sent.
+    virtual void SetHeadOnly(const bool is_head_only);
+    bool IsHeadOnly() const;
+    // Response to HTTP/1.0 request: chunked body is sent without chunk framing and ends when
+    // the connection is closed. Has no effect on messages which are not chunked.
+    virtual void SetCloseDelimited();
+    bool IsCloseDelimited() const;
+    // Canonical responses returned by factories without timer are serialized once and shared
+    // by all connections. Such message is sent as it is and must not be changed.
+    bool IsImmutable() const;
+    // Immutable copy of the immutable message without body, answers HEAD requests.
+    const sptr& GetHeadOnlyTwin() const;
+    // Immutable copy of the response, which is not sent itself but shared by the messages
+    // Reuse() makes out of it. Only responses with body kept in memory are shared, empty
+    // pointer is returned for the others. Connection and X-Request-Id headers are left out.
+    sptr Share() const;
     bool ConnectionShouldBeClosed() const;
 
-    static sptr OK(const std::string& request_id, const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr NoContent(const std::string& request_id, const bool is_persistent, const clocks::HiResTimer* t = 0);
+    static sptr OK(const std::string& request_id, const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr NoContent(const std::string& request_id, const bool is_persistent, const clocks::Timestamp* t = 0);
     static sptr BadRequest();
     static sptr BadRequest(const std::string& request_id);
-    static sptr Forbidden(const clocks::HiResTimer* t = 0);
-    static sptr Forbidden(const std::string& request_id, const clocks::HiResTimer* t = 0);
-    static sptr NotFound(const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr NotFound(const std::string& content, const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr NotFound(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr NotAcceptable(const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr NotAcceptable(const std::string& content, const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr NotAcceptable(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr RequestTimeout(const std::string& request_id, const bool is_persistent, const clocks::HiResTimer* t = 0);
-    static sptr TooManyConnections(const clocks::HiResTimer* t = 0);
+    static sptr Forbidden(const clocks::Timestamp* t = 0);
+    static sptr Forbidden(const std::string& request_id, const clocks::Timestamp* t = 0);
+    static sptr NotFound(const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr NotFound(const std::string& content, const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr NotFound(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr NotAcceptable(const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr NotAcceptable(const std::string& content, const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr NotAcceptable(const std::string& request_id, const std::string& content, const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr RequestTimeout(const std::string& request_id, const bool is_persistent, const clocks::Timestamp* t = 0);
+    static sptr EntityTooLarge(const clocks::Timestamp* t = 0);
+    static sptr TooManyConnections(const clocks::Timestamp* t = 0);
+    // Message sending bytes of the shared response with Connection header of its own.
+    static sptr Reuse(const sptr& shared, const bool is_persistent, const clocks::Timestamp* t = 0);
+
+  protected:
+    // Body follows the header as "Transfer-Encoding: chunked" stream.
+    void SetChunked_();
 
   private:
-    static void UpdateReservation_(const size_t length);
+    // Message sending bytes of the canonical one, owned by a single connection.
+    OutgoingHttpMessage(const sptr& canonical, const clocks::Timestamp* timer);
+
+    static sptr Prebuild_(const HttpCode code, const bool is_persistent);
+    static sptr Prebuilt_(const sptr& canonical, const clocks::Timestamp* timer);
 
     HttpMethod method_;
     HttpCode response_code_;
 
     std::string uri_;
-    std::string header_;
+    HeaderBuilder header_;
+    const char* data_;
     size_t data_len_;
-    size_t len_;
-    char* data_;
+    std::string owned_data_;
+    Blob::sptr shared_data_;
+    FileBody::sptr file_data_;
+    bool is_head_only_;
+    bool is_chunked_;
+    bool is_close_delimited_;
+    // Serialized status line and headers, body follows them as a separate segment.
     char* message_;
-
-    clocks::HiResTimer* timer_;
-
-    static tbb::atomic<size_t> header_reservation_;
+    size_t message_len_;
+    size_t body_len_;
+    // Prebuilt message keeps all its bytes but common headers in the shared data, its
+    // status line and header are that long.
+    size_t prebuilt_status_len_;
+    size_t prebuilt_header_len_;
+    // Sent after common headers of prebuilt message, shared bytes lack it.
+    const char* connection_line_;
+    size_t connection_line_len_;
+    bool is_immutable_;
+    sptr head_only_twin_;
+
+    static sptr bad_request_;
+    static sptr forbidden_;
+    static sptr not_found_;
+    static sptr not_found_persistent_;
+    static sptr entity_too_large_;
+    static sptr too_many_connections_;
   };
 
 } // namespace webserver
@@ -0,0 +1,138 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "requestcoalescer.h"
+#include "responsecache.h"
+#include "server.h"
+
+#include <cctype>
+
+
+namespace webserver {
+
+  RequestCoalescer::RequestCoalescer() {
+    coalesced_ = 0;
+  }
+
+
+  void RequestCoalescer::AddPrefix(const std::string& uri_prefix) {
+    prefixes_.push_back(uri_prefix);
+  }
+
+
+  void RequestCoalescer::AddVaryHeader(const std::string& name) {
+    std::string lower(name);
+    for (std::string::iterator i = lower.begin(); i != lower.end(); ++i) {
+      *i = static_cast<char>(std::tolower(static_cast<unsigned char>(*i)));
+    }
+    vary_headers_.push_back(lower);
+  }
+
+
+  bool RequestCoalescer::GetKey(const IncomingHttpMessage& request, std::string& key) const {
+    if (request.GetMethod() != GET && request.GetMethod() != HEAD) {
+      return false;
+    }
+
+    bool is_matched = false;
+    for (std::vector<std::string>::const_iterator i = prefixes_.begin(); i != prefixes_.end() && !is_matched; ++i) {
+      is_matched = request.GetUri().compare(0, i->size(), *i) == 0;
+    }
+
+    // Response to such request may be meant for its client alone.
+    if (!is_matched || ResponseCache::HasCredentials(request, vary_headers_)) {
+      return false;
+    }
+
+    ResponseCache::BuildKey(request, vary_headers_, key);
+    return true;
+  }
+
+
+  RequestCoalescer::Role RequestCoalescer::Join(const std::string& key, const BaseConnection::wptr& connection,
+                                                const std::tr1::shared_ptr<Server>& server, const IncomingHttpMessage::sptr& request) {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    std::map<std::string, Flight>::iterator i = flights_.find(key);
+
+    if (i == flights_.end()) {
+      if (request->GetMethod() != GET) {
+        return ROLE_NONE;
+      }
+
+      flights_.insert(std::make_pair(key, Flight()));
+      return ROLE_LEADER;
+    }
+
+    Waiter waiter;
+    waiter.connection = connection;
+    waiter.server = server;
+    waiter.request = request;
+    i->second.push_back(waiter);
+    ++coalesced_;
+    return ROLE_WAITER;
+  }
+
+
+  void RequestCoalescer::Complete(const std::string& key, const OutgoingHttpMessage::sptr& response, OutgoingHttpMessage::sptr shared) {
+    Flight waiters;
+    if (!Take_(key, waiters) || waiters.empty()) {
+      return;
+    }
+
+    // Response meant for the leader alone goes to no one else, handlers answer the waiters.
+    const bool is_shareable = ResponseCache::IsShareable(*response, vary_headers_);
+
+    // Canonical responses are shared already.
+    if (is_shareable && !response->IsImmutable() && !shared) {
+      shared = response->Share();
+    }
+
+    for (Flight::const_iterator i = waiters.begin(); i != waiters.end(); ++i) {
+      if (!is_shareable) {
+        i->server->PostIncoming(i->connection, i->request);
+      }
+      else if (response->IsImmutable()) {
+        i->server->PostMessage(i->connection, response, i->request);
+      }
+      else if (shared) {
+        i->server->PostMessage(i->connection, OutgoingHttpMessage::Reuse(shared, i->request->IsPersistent(), &i->request->GetTimer()), i->request);
+      }
+      else {
+        i->server->PostIncoming(i->connection, i->request);
+      }
+    }
+  }
+
+
+  void RequestCoalescer::Abandon(const std::string& key) {
+    Flight waiters;
+    if (!Take_(key, waiters)) {
+      return;
+    }
+
+    for (Flight::const_iterator i = waiters.begin(); i != waiters.end(); ++i) {
+      i->server->PostIncoming(i->connection, i->request);
+    }
+  }
+
+
+  uint64_t RequestCoalescer::GetCoalesced() const {
+    return coalesced_;
+  }
+
+
+  bool RequestCoalescer::Take_(const std::string& key, Flight& waiters) {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    std::map<std::string, Flight>::iterator i = flights_.find(key);
+
+    if (i == flights_.end()) {
+      return false;
+    }
+
+    waiters.swap(i->second);
+    flights_.erase(i);
+    return true;
+  }
+
+} // namespace webserver
@@ -0,0 +1,93 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_REQUEST_COALESCER_H__
+#define WEBSERVER_REQUEST_COALESCER_H__
+
+#include "baseconnection.h"
+#include "incominghttpmessage.h"
+#include "outgoinghttpmessage.h"
+
+#include <base/prototype.h>
+#include <map>
+#include <string>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+#include <tr1/memory>
+#include <vector>
+
+
+namespace webserver {
+
+  class Server;
+
+  //
+  // Single-flight dispatch of identical GET requests.
+  //
+  // The first request with a key goes to handlers and leads the flight. Identical requests
+  // arriving on any connection of any server before its response is emitted wait for it:
+  // response is shared once and sent to every one of them from their servers' threads,
+  // handlers never see them. If response cannot be shared (file or stream, or one the
+  // response cache would not store either) or the leading connection is closed first,
+  // waiting requests are passed to handlers after all.
+  //
+  // Requests are keyed like in ResponseCache, only URIs under added prefixes are coalesced.
+  // Requests carrying Authorization or Cookie are not, unless the header is a vary header.
+  // Prefixes and headers are set up before the coalescer is given to servers.
+  //
+
+  class RequestCoalescer : public base::NonCopyable {
+  public:
+    typedef std::tr1::shared_ptr<RequestCoalescer> sptr;
+
+    typedef enum {
+      // Request is not coalesced.
+      ROLE_NONE,
+      // Request is passed to handlers, its response is shared with the others.
+      ROLE_LEADER,
+      // Request is answered with leader's response.
+      ROLE_WAITER
+    } Role;
+
+    RequestCoalescer();
+
+    // Only URIs starting with one of prefixes are coalesced, none if no prefix is added.
+    void AddPrefix(const std::string& uri_prefix);
+    void AddVaryHeader(const std::string& name);
+
+    // Returns false if request is not coalesced.
+    bool GetKey(const IncomingHttpMessage& request, std::string& key) const;
+    // Called on server's thread of the connection with numbered request. HEAD requests join
+    // flights but never lead them.
+    Role Join(const std::string& key, const BaseConnection::wptr& connection,
+              const std::tr1::shared_ptr<Server>& server, const IncomingHttpMessage::sptr& request);
+    // Fans response of the leader out to waiting requests. Shared copy of the response is
+    // made unless given.
+    void Complete(const std::string& key, const OutgoingHttpMessage::sptr& response, OutgoingHttpMessage::sptr shared);
+    // Leader is gone without response, waiting requests are passed to handlers.
+    void Abandon(const std::string& key);
+
+    uint64_t GetCoalesced() const;
+
+  private:
+    typedef struct {
+      BaseConnection::wptr connection;
+      std::tr1::shared_ptr<Server> server;
+      IncomingHttpMessage::sptr request;
+    } Waiter;
+
+    typedef std::vector<Waiter> Flight;
+
+    bool Take_(const std::string& key, Flight& waiters);
+
+    std::vector<std::string> prefixes_;
+    std::vector<std::string> vary_headers_;
+    tbb::spin_mutex mutex_;
+    std::map<std::string, Flight> flights_;
+    tbb::atomic<uint64_t> coalesced_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_REQUEST_COALESCER_H__
@@ -0,0 +1,46 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "requestphases.h"
+
+#include <clock/timestamp.h>
+#include <cstring>
+
+
+namespace webserver {
+
+  RequestPhases::RequestPhases() {
+    ::memset(times_, 0, sizeof(times_));
+  }
+
+
+  void RequestPhases::Mark(const RequestPhase phase) {
+    times_[phase] = Now();
+  }
+
+
+  void RequestPhases::Set(const RequestPhase phase, const uint64_t time) {
+    times_[phase] = time;
+  }
+
+
+  uint64_t RequestPhases::Get(const RequestPhase phase) const {
+    return times_[phase];
+  }
+
+
+  uint64_t RequestPhases::GetDuration(const RequestPhase phase) const {
+    if (phase == PHASE_ACCEPTED || times_[phase - 1] == 0 || times_[phase] < times_[phase - 1]) {
+      return 0;
+    }
+
+    return times_[phase] - times_[phase - 1];
+  }
+
+
+  uint64_t RequestPhases::Now() {
+    return clocks::Timestamp::Now().GetNanoseconds();
+  }
+
+} // namespace webserver
@@ -0,0 +1,67 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_REQUEST_PHASES_H__
+#define WEBSERVER_REQUEST_PHASES_H__
+
+#include <cstddef>
+#include <inttypes.h>
+
+
+namespace webserver {
+
+  // Moments in the life of a request, in the order they are reached. Time spent in a phase
+  // is measured from the end of the previous one, so accepted has no duration of its own.
+  typedef enum {
+    // Connection was accepted, known for the first request of a connection only.
+    PHASE_ACCEPTED,
+    // Read which brought the first byte of request.
+    PHASE_FIRST_BYTE,
+    PHASE_PARSED,
+    // Handler took request from the connection.
+    PHASE_DEQUEUED,
+    // Response was handed to the connection.
+    PHASE_HANDLED,
+    PHASE_SERIALIZED,
+    // Last byte of response was written to the socket.
+    PHASE_WRITTEN,
+    PHASES_COUNT
+  } RequestPhase;
+
+  const char* const PHASE_NAMES[PHASES_COUNT] = {
+    "accepted",
+    "first_byte",
+    "parsed",
+    "dequeued",
+    "handled",
+    "serialized",
+    "written"
+  };
+
+
+  //
+  // Monotonic timestamps of request phases, in nanoseconds. Phases not reached are zero.
+  //
+
+  class RequestPhases {
+  public:
+    RequestPhases();
+
+    void Mark(const RequestPhase phase);
+    void Set(const RequestPhase phase, const uint64_t time);
+    uint64_t Get(const RequestPhase phase) const;
+
+    // Nanoseconds from the end of the previous phase to the end of phase, zero unless both
+    // were reached.
+    uint64_t GetDuration(const RequestPhase phase) const;
+
+    static uint64_t Now();
+
+  private:
+    uint64_t times_[PHASES_COUNT];
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_REQUEST_PHASES_H__
@@ -0,0 +1,298 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "responsecache.h"
+
+#include <algorithm>
+#include <cctype>
+#include <cstring>
+#include <tr1/functional>
+
+extern "C" {
+#include <strings.h>
+}
+
+
+namespace webserver {
+
+  namespace {
+    // Entry bookkeeping besides the key and response bytes.
+    const size_t ENTRY_OVERHEAD = 128;
+    const char* const CREDENTIAL_HEADERS[] = { "authorization", "cookie" };
+
+
+    std::string ToLower(const std::string& str) {
+      std::string lower(str);
+      for (std::string::iterator i = lower.begin(); i != lower.end(); ++i) {
+        *i = static_cast<char>(std::tolower(static_cast<unsigned char>(*i)));
+      }
+      return lower;
+    }
+
+
+    // Checks if comma-separated list contains token, case-insensitively.
+    bool ListContains(const std::string& list, const char* token) {
+      const size_t len = ::strlen(token);
+
+      for (size_t p = 0; p < list.size(); ) {
+        size_t end = list.find(',', p);
+        if (end == std::string::npos) {
+          end = list.size();
+        }
+
+        size_t begin = p;
+        while (begin < end && (list[begin] == ' ' || list[begin] == '\t')) {
+          ++begin;
+        }
+        size_t item_end = begin;
+        while (item_end < end && list[item_end] != ' ' && list[item_end] != '\t' && list[item_end] != '=') {
+          ++item_end;
+        }
+
+        if (item_end - begin == len && ::strncasecmp(list.c_str() + begin, token, len) == 0) {
+          return true;
+        }
+
+        p = end + 1;
+      }
+
+      return false;
+    }
+  }
+
+
+  ResponseCache::ResponseCache(const size_t memory_budget, const size_t shards_count)
+  : shard_budget_(memory_budget / (shards_count ? shards_count : 1)) {
+    for (size_t i = 0; i < (shards_count ? shards_count : 1); ++i) {
+      std::tr1::shared_ptr<Shard> shard = std::tr1::shared_ptr<Shard>(new Shard());
+      shard->memory = 0;
+      shard->hits = 0;
+      shard->misses = 0;
+      shards_.push_back(shard);
+    }
+  }
+
+
+  void ResponseCache::AddRule(const std::string& uri_prefix, const unsigned int ttl) {
+    rules_.push_back(std::make_pair(uri_prefix, ttl));
+  }
+
+
+  void ResponseCache::AddVaryHeader(const std::string& name) {
+    vary_headers_.push_back(ToLower(name));
+  }
+
+
+  bool ResponseCache::GetKey(const IncomingHttpMessage& request, std::string& key, unsigned int& ttl) const {
+    if (request.GetMethod() != GET && request.GetMethod() != HEAD) {
+      return false;
+    }
+
+    const std::string& uri = request.GetUri();
+    size_t matched = 0;
+    bool is_matched = false;
+
+    // The longest matching prefix wins.
+    for (std::vector<std::pair<std::string, unsigned int> >::const_iterator i = rules_.begin(); i != rules_.end(); ++i) {
+      if (i->first.size() >= matched && uri.compare(0, i->first.size(), i->first) == 0) {
+        matched = i->first.size();
+        ttl = i->second;
+        is_matched = true;
+      }
+    }
+
+    if (!is_matched || ttl == 0 || HasCredentials(request, vary_headers_)) {
+      return false;
+    }
+
+    BuildKey(request, vary_headers_, key);
+    return true;
+  }
+
+
+  void ResponseCache::BuildKey(const IncomingHttpMessage& request, const std::vector<std::string>& headers, std::string& key) {
+    // HEAD is answered with GET response, so both share the key.
+    key.assign("GET ");
+    key.append(request.GetUri());
+
+    for (std::vector<std::string>::const_iterator i = headers.begin(); i != headers.end(); ++i) {
+      key.append("\n");
+      IncomingHttpMessage::HttpPair header;
+      if (request.FindHeader(i->c_str(), header)) {
+        key.append(header->value);
+      }
+    }
+  }
+
+
+  bool ResponseCache::HasCredentials(const IncomingHttpMessage& request, const std::vector<std::string>& headers) {
+    for (size_t i = 0; i < sizeof(CREDENTIAL_HEADERS) / sizeof(CREDENTIAL_HEADERS[0]); ++i) {
+      IncomingHttpMessage::HttpPair header;
+      if (request.FindHeader(CREDENTIAL_HEADERS[i], header) &&
+          std::find(headers.begin(), headers.end(), CREDENTIAL_HEADERS[i]) == headers.end()) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  bool ResponseCache::IsShareable(const OutgoingHttpMessage& response, const std::vector<std::string>& vary_headers) {
+    if (response.GetResponseCode() != HTTP_OK) {
+      return false;
+    }
+
+    std::string value;
+    if (response.FindHeader("set-cookie", value)) {
+      return false;
+    }
+
+    if (response.FindHeader("cache-control", value) &&
+        (ListContains(value, "no-store") || ListContains(value, "private") || ListContains(value, "no-cache"))) {
+      return false;
+    }
+
+    // Every header response varies on has to be a part of the key.
+    if (response.FindHeader("vary", value)) {
+      for (size_t p = 0; p < value.size(); ) {
+        size_t end = value.find(',', p);
+        if (end == std::string::npos) {
+          end = value.size();
+        }
+
+        size_t begin = p;
+        while (begin < end && value[begin] == ' ') {
+          ++begin;
+        }
+        size_t name_end = end;
+        while (name_end > begin && value[name_end - 1] == ' ') {
+          --name_end;
+        }
+
+        const std::string name = ToLower(value.substr(begin, name_end - begin));
+        if (!name.empty() && std::find(vary_headers.begin(), vary_headers.end(), name) == vary_headers.end()) {
+          return false;
+        }
+
+        p = end + 1;
+      }
+    }
+
+    return true;
+  }
+
+
+  OutgoingHttpMessage::sptr ResponseCache::Lookup(const std::string& key, const time_t now) {
+    Shard& shard = GetShard_(key);
+    tbb::spin_mutex::scoped_lock lock(shard.mutex);
+
+    std::map<std::string, Entry>::iterator i = shard.entries.find(key);
+    if (i == shard.entries.end()) {
+      ++shard.misses;
+      return OutgoingHttpMessage::sptr();
+    }
+
+    if (i->second.expires <= now) {
+      Erase_(shard, i);
+      ++shard.misses;
+      return OutgoingHttpMessage::sptr();
+    }
+
+    shard.lru.splice(shard.lru.begin(), shard.lru, i->second.lru);
+    ++shard.hits;
+    return i->second.response;
+  }
+
+
+  OutgoingHttpMessage::sptr ResponseCache::Store(const std::string& key, const unsigned int ttl, const OutgoingHttpMessage& response, const time_t now) {
+    if (!IsShareable(response, vary_headers_)) {
+      return OutgoingHttpMessage::sptr();
+    }
+
+    OutgoingHttpMessage::sptr shared = response.Share();
+    if (!shared) {
+      return shared;
+    }
+
+    const size_t cost = shared->GetLength() + key.size() * 2 + ENTRY_OVERHEAD;
+    if (cost > shard_budget_) {
+      return OutgoingHttpMessage::sptr();
+    }
+
+    Shard& shard = GetShard_(key);
+    tbb::spin_mutex::scoped_lock lock(shard.mutex);
+
+    std::map<std::string, Entry>::iterator i = shard.entries.find(key);
+    if (i != shard.entries.end()) {
+      Erase_(shard, i);
+    }
+
+    while (shard.memory + cost > shard_budget_ && !shard.lru.empty()) {
+      Erase_(shard, shard.entries.find(shard.lru.back()));
+    }
+
+    shard.lru.push_front(key);
+    Entry& entry = shard.entries[key];
+    entry.response = shared;
+    entry.expires = now + static_cast<time_t>(ttl);
+    entry.cost = cost;
+    entry.lru = shard.lru.begin();
+    shard.memory += cost;
+    return shared;
+  }
+
+
+  void ResponseCache::Clear() {
+    for (std::vector<std::tr1::shared_ptr<Shard> >::iterator i = shards_.begin(); i != shards_.end(); ++i) {
+      tbb::spin_mutex::scoped_lock lock((*i)->mutex);
+      (*i)->entries.clear();
+      (*i)->lru.clear();
+      (*i)->memory = 0;
+    }
+  }
+
+
+  uint64_t ResponseCache::GetHits() const {
+    uint64_t hits = 0;
+    for (std::vector<std::tr1::shared_ptr<Shard> >::const_iterator i = shards_.begin(); i != shards_.end(); ++i) {
+      tbb::spin_mutex::scoped_lock lock((*i)->mutex);
+      hits += (*i)->hits;
+    }
+    return hits;
+  }
+
+
+  uint64_t ResponseCache::GetMisses() const {
+    uint64_t misses = 0;
+    for (std::vector<std::tr1::shared_ptr<Shard> >::const_iterator i = shards_.begin(); i != shards_.end(); ++i) {
+      tbb::spin_mutex::scoped_lock lock((*i)->mutex);
+      misses += (*i)->misses;
+    }
+    return misses;
+  }
+
+
+  size_t ResponseCache::GetMemory() const {
+    size_t memory = 0;
+    for (std::vector<std::tr1::shared_ptr<Shard> >::const_iterator i = shards_.begin(); i != shards_.end(); ++i) {
+      tbb::spin_mutex::scoped_lock lock((*i)->mutex);
+      memory += (*i)->memory;
+    }
+    return memory;
+  }
+
+
+  ResponseCache::Shard& ResponseCache::GetShard_(const std::string& key) {
+    return *shards_[std::tr1::hash<std::string>()(key) % shards_.size()];
+  }
+
+
+  void ResponseCache::Erase_(Shard& shard, const std::map<std::string, Entry>::iterator& i) {
+    shard.memory -= i->second.cost;
+    shard.lru.erase(i->second.lru);
+    shard.entries.erase(i);
+  }
+
+} // namespace webserver
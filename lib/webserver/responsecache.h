@@ -0,0 +1,99 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_RESPONSE_CACHE_H__
+#define WEBSERVER_RESPONSE_CACHE_H__
+
+#include "incominghttpmessage.h"
+#include "outgoinghttpmessage.h"
+
+#include <base/prototype.h>
+#include <ctime>
+#include <list>
+#include <map>
+#include <string>
+#include <tbb/spin_mutex.h>
+#include <tr1/memory>
+#include <vector>
+
+
+namespace webserver {
+
+  //
+  // Cache of complete responses to GET requests.
+  //
+  // Only URIs starting with one of configured prefixes are cached, each prefix with its own
+  // time to live. Responses are keyed by method, URI with query and values of configured
+  // vary headers; response listing other headers in Vary, setting cookies or forbidding
+  // storage in Cache-Control is not cached, neither is response to request with credentials
+  // not in the key. HEAD requests are answered from GET responses.
+  //
+  // Connections look cached responses up on server's thread and send them without passing
+  // requests to handlers. Cache is split into shards, each with its own lock, LRU order and
+  // part of the memory budget, so servers running on different cores rarely meet.
+  //
+  // Rules and vary headers are set up before the cache is given to servers.
+  //
+
+  class ResponseCache : public base::NonCopyable {
+  public:
+    typedef std::tr1::shared_ptr<ResponseCache> sptr;
+
+    explicit ResponseCache(const size_t memory_budget = 64 * 1024 * 1024, const size_t shards_count = 16);
+
+    void AddRule(const std::string& uri_prefix, const unsigned int ttl);
+    void AddVaryHeader(const std::string& name);
+
+    // Returns false if responses to the request are not cached.
+    bool GetKey(const IncomingHttpMessage& request, std::string& key, unsigned int& ttl) const;
+    // Shared response, see OutgoingHttpMessage::Reuse(), or empty pointer.
+    OutgoingHttpMessage::sptr Lookup(const std::string& key, const time_t now);
+    // Returns shared response which was stored, or empty pointer if response may not be cached.
+    OutgoingHttpMessage::sptr Store(const std::string& key, const unsigned int ttl, const OutgoingHttpMessage& response, const time_t now);
+    void Clear();
+
+    // Key of GET and HEAD requests: URI with query and values of given lower-case headers.
+    static void BuildKey(const IncomingHttpMessage& request, const std::vector<std::string>& headers, std::string& key);
+    // Request carries Authorization or Cookie header which is not one of given lower-case
+    // headers, so its response may be meant for this client alone.
+    static bool HasCredentials(const IncomingHttpMessage& request, const std::vector<std::string>& headers);
+    // Response may be sent to other clients whose requests have the same key: it is 200 OK,
+    // sets no cookies, Cache-Control allows storing it and it varies on given headers only.
+    static bool IsShareable(const OutgoingHttpMessage& response, const std::vector<std::string>& vary_headers);
+
+    uint64_t GetHits() const;
+    uint64_t GetMisses() const;
+    size_t GetMemory() const;
+
+  private:
+    typedef std::list<std::string> LruList;
+
+    typedef struct {
+      OutgoingHttpMessage::sptr response;
+      time_t expires;
+      size_t cost;
+      LruList::iterator lru;
+    } Entry;
+
+    typedef struct {
+      tbb::spin_mutex mutex;
+      std::map<std::string, Entry> entries;
+      LruList lru;
+      size_t memory;
+      uint64_t hits;
+      uint64_t misses;
+    } Shard;
+
+    Shard& GetShard_(const std::string& key);
+    static void Erase_(Shard& shard, const std::map<std::string, Entry>::iterator& i);
+
+    const size_t shard_budget_;
+    std::vector<std::pair<std::string, unsigned int> > rules_;
+    std::vector<std::string> vary_headers_;
+    std::vector<std::tr1::shared_ptr<Shard> > shards_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_RESPONSE_CACHE_H__
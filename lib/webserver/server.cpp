@@ -3,6 +3,7 @@
 // Copyright 2010 LibWebserver Authors. All rights reserved.
 
 #include "server.h"
+#include "commonheaders.h"
 #include "exception.h"
 #include "status.h"
 
@@ -11,15 +12,25 @@ namespace webserver {
 
   unsigned int Server::max_connects_ = 1000;
   unsigned int Server::connection_timeout_ = 10;
+  size_t Server::max_buffer_length_ = 1024 * 1024;
+  size_t Server::max_body_length_ = 64 * 1024 * 1024;
   tbb::atomic<unsigned int> Server::servers_count_;
+  tbb::atomic<unsigned int> Server::servers_created_;
 
 
-  Server::Server() {
+  Server::Server()
+  : performed_(0)
+  , handled_(0) {
     Constructor_();
   }
 
 
   Server::~Server() {
+    if (metrics_exporter_) {
+      metrics_exporter_->Detach(*this);
+    }
+
+    notifier_.Close();
     destroy(poll_);
 
     if (--servers_count_ == 0) {
@@ -50,6 +61,73 @@ namespace webserver {
   }
 
 
+  void Server::SetMaxBufferLength(const size_t length) {
+    max_buffer_length_ = length;
+  }
+
+
+  void Server::SetMaxBodyLength(const size_t length) {
+    max_body_length_ = length;
+  }
+
+
+  void Server::SetBodySinkFactory(const BodySinkFactory::sptr& factory) {
+    body_sink_factory_ = factory;
+  }
+
+
+  const BodySinkFactory::sptr& Server::GetBodySinkFactory() const {
+    return body_sink_factory_;
+  }
+
+
+  void Server::SetResponseCache(const ResponseCache::sptr& cache) {
+    response_cache_ = cache;
+  }
+
+
+  const ResponseCache::sptr& Server::GetResponseCache() const {
+    return response_cache_;
+  }
+
+
+  void Server::SetRequestCoalescer(const RequestCoalescer::sptr& coalescer) {
+    request_coalescer_ = coalescer;
+  }
+
+
+  const RequestCoalescer::sptr& Server::GetRequestCoalescer() const {
+    return request_coalescer_;
+  }
+
+
+  void Server::SetMetricsExporter(const MetricsExporter::sptr& exporter) {
+    if (metrics_exporter_) {
+      metrics_exporter_->Detach(*this);
+    }
+
+    metrics_exporter_ = exporter;
+    if (metrics_exporter_) {
+      metrics_exporter_->Attach(*this);
+    }
+  }
+
+
+  const MetricsExporter::sptr& Server::GetMetricsExporter() const {
+    return metrics_exporter_;
+  }
+
+
+  void Server::SetSlowRequestLog(const SlowRequestLog::sptr& log) {
+    slow_request_log_ = log;
+  }
+
+
+  const SlowRequestLog::sptr& Server::GetSlowRequestLog() const {
+    return slow_request_log_;
+  }
+
+
   io::Poll* Server::GetPoll() const {
     return poll_;
   }
@@ -83,7 +161,36 @@ namespace webserver {
   }
 
 
+  void Server::PostMessage(const BaseConnection::wptr& c, const OutgoingMessage::sptr& message,
+                           const IncomingMessage::sptr& request) {
+    PostedMessage posted;
+    posted.connection = c;
+    posted.message = message;
+    posted.request = request;
+    posted_.push(posted);
+    notifier_.Notify();
+  }
+
+
+  void Server::PostIncoming(const BaseConnection::wptr& c, const IncomingMessage::sptr& request) {
+    PostedMessage posted;
+    posted.connection = c;
+    posted.request = request;
+    posted_.push(posted);
+    notifier_.Notify();
+  }
+
+
+  void Server::PostWrite(const BaseConnection::wptr& c) {
+    PostedMessage posted;
+    posted.connection = c;
+    posted_.push(posted);
+    notifier_.Notify();
+  }
+
+
   unsigned int Server::ActiveConnections() const {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
     return static_cast<unsigned int>(connections_.size());
   }
 
@@ -93,13 +200,83 @@ namespace webserver {
   }
 
 
+  size_t Server::GetMaxBufferLength() const {
+    return max_buffer_length_;
+  }
+
+
+  size_t Server::GetMaxBodyLength() const {
+    return max_body_length_;
+  }
+
+
+  unsigned int Server::GetId() const {
+    return id_;
+  }
+
+
+  ServerStats& Server::GetStats() {
+    return stats_;
+  }
+
+
+  const ServerStats& Server::GetStats() const {
+    return stats_;
+  }
+
+
   void Server::Perform() {
-    poll_->DoPoll(1000);
+    const uint64_t started = RequestPhases::Now();
+    if (performed_ != 0) {
+      stats_.Add(ServerStats::COUNTER_HANDLING_TIME, started - performed_);
+      stats_.Record(ServerStats::DISTRIBUTION_HANDLING_TIME, (started - performed_) / 1000);
+      stats_.Record(ServerStats::DISTRIBUTION_HANDLED, handled_);
+    }
+    handled_ = 0;
+
+    const int events = poll_->DoPoll(1000);
+    const uint64_t polled = RequestPhases::Now();
+    CommonHeaders::Update(::time(0));
     poll_->Perform();
+    DeliverPosted_();
+    performed_ = RequestPhases::Now();
+
+    stats_.Add(ServerStats::COUNTER_ITERATIONS);
+    stats_.Add(ServerStats::COUNTER_EVENTS, events > 0 ? events : 0);
+    stats_.Add(ServerStats::COUNTER_WAIT_TIME, polled - started);
+    stats_.Add(ServerStats::COUNTER_PERFORM_TIME, performed_ - polled);
+    stats_.Set(ServerStats::COUNTER_POLL_CONTROLS, poll_->GetControlCalls());
+    stats_.Record(ServerStats::DISTRIBUTION_EVENTS, events > 0 ? events : 0);
+    stats_.Record(ServerStats::DISTRIBUTION_WAIT_TIME, (polled - started) / 1000);
+    stats_.Record(ServerStats::DISTRIBUTION_PERFORM_TIME, (performed_ - polled) / 1000);
+    stats_.Record(ServerStats::DISTRIBUTION_ACTIVITY, activity_.size());
+    stats_.Tick(performed_);
+  }
+
+
+  void Server::DeliverPosted_() {
+    PostedMessage posted;
+    while (posted_.try_pop(posted)) {
+      if (BaseConnection::sptr c = posted.connection.lock()) {
+        if (!posted.message && posted.request) {
+          c->DispatchIncoming(posted.request);
+        }
+        else if (!posted.message) {
+          c->ResumeWrite();
+        }
+        else if (posted.request) {
+          c->SendMessage(posted.message, posted.request);
+        }
+        else {
+          c->SendMessage(posted.message);
+        }
+      }
+    }
   }
 
 
   void Server::Constructor_() {
+    id_ = servers_created_++;
     if (servers_count_++ == 0) {
       Status::Init(true, true);
     }
@@ -109,6 +286,10 @@ namespace webserver {
         (poll_ = io::PollEPoll::Create(max_connects_ + 10)) == 0) {
       base_throw(IOException, "No suitable poll mechanism detected.");
     }
+
+    if (!notifier_.Open(poll_)) {
+      base_throw(IOException, "Could not open server notification pipe.");
+    }
   }
 
 } // namespace webserver
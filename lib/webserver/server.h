@@ -8,12 +8,20 @@
 #include "baseconnection.h"
 #include "baselistener.h"
 #include "httptypes.h"
+#include "messagebody.h"
+#include "metricsexporter.h"
+#include "notifier.h"
+#include "requestcoalescer.h"
+#include "responsecache.h"
+#include "serverstats.h"
+#include "slowrequestlog.h"
 
 #include <clock/clock.h>
 #include <inttypes.h>
 #include <io/io.h>
 #include <set>
 #include <tbb/atomic.h>
+#include <tbb/concurrent_queue.h>
 #include <tbb/spin_mutex.h>
 #include <threads/thread.h>
 #include <tr1/memory>
@@ -43,6 +51,27 @@ namespace webserver {
 
     static void SetMaxConnects(const unsigned int max_connects);
     static void SetConnectionTimeout(const unsigned int timeout);
+    // Connection is closed if its unparsed data grows above this length.
+    static void SetMaxBufferLength(const size_t length);
+    // Requests with longer bodies are answered with 413, zero allows any length.
+    static void SetMaxBodyLength(const size_t length);
+
+    // Factory deciding which request bodies are streamed to handler's sinks.
+    void SetBodySinkFactory(const BodySinkFactory::sptr& factory);
+    const BodySinkFactory::sptr& GetBodySinkFactory() const;
+    // Cache answering requests on server's thread, may be shared by servers.
+    void SetResponseCache(const ResponseCache::sptr& cache);
+    const ResponseCache::sptr& GetResponseCache() const;
+    // Coalescer of identical requests, shared by servers whose requests are coalesced.
+    void SetRequestCoalescer(const RequestCoalescer::sptr& coalescer);
+    const RequestCoalescer::sptr& GetRequestCoalescer() const;
+    // Metrics endpoint answered on server's thread, may be shared by servers. Exporter
+    // renders event loop metrics of every server it is given to.
+    void SetMetricsExporter(const MetricsExporter::sptr& exporter);
+    const MetricsExporter::sptr& GetMetricsExporter() const;
+    // Log of slow requests, may be shared by servers.
+    void SetSlowRequestLog(const SlowRequestLog::sptr& log);
+    const SlowRequestLog::sptr& GetSlowRequestLog() const;
 
     // Create listening non-blocking socket bound to host:port with timeout in milliseconds.
     template<class T>
@@ -54,8 +83,24 @@ namespace webserver {
     template<class T>
     bool GetActiveConnection(std::tr1::shared_ptr<T>& c);
     void ActivityOn(const BaseConnection::wptr& c);
+    // Thread-safe way to answer a request from outside of server's thread: response is
+    // passed to BaseConnection::SendMessage() on the next Perform().
+    void PostMessage(const BaseConnection::wptr& c, const OutgoingMessage::sptr& message,
+                     const IncomingMessage::sptr& request);
+    // Thread-safe way to pass request to handlers, see BaseConnection::DispatchIncoming().
+    void PostIncoming(const BaseConnection::wptr& c, const IncomingMessage::sptr& request);
+    // Thread-safe way to resume writing on connection, see BaseConnection::WakeWrite().
+    void PostWrite(const BaseConnection::wptr& c);
+    // Safe to call from any thread.
     unsigned int ActiveConnections() const;
     unsigned int GetConnectionTimeout() const;
+    size_t GetMaxBufferLength() const;
+    size_t GetMaxBodyLength() const;
+    // Distinguishes servers of the process, numbered from zero in order of creation.
+    unsigned int GetId() const;
+    // Event loop statistics, recorded by server's thread.
+    ServerStats& GetStats();
+    const ServerStats& GetStats() const;
 
     void Perform();
 
@@ -64,18 +109,41 @@ namespace webserver {
     Server(std::tr1::shared_ptr<threads::Thread<BaseListener> >& listener);
 
     void Constructor_();
+    void DeliverPosted_();
+
+    typedef struct {
+      BaseConnection::wptr connection;
+      OutgoingMessage::sptr message;
+      IncomingMessage::sptr request;
+    } PostedMessage;
 
     static unsigned int max_connects_;
     static unsigned int connection_timeout_;
+    static size_t max_buffer_length_;
+    static size_t max_body_length_;
     static tbb::atomic<unsigned int> servers_count_;
+    static tbb::atomic<unsigned int> servers_created_;
+
+    unsigned int id_;
 
     typedef std::set<BaseConnection::sptr, ConnectionLess> ConnectionSet;
     ConnectionSet connections_;
     ConnectionSet activity_;
 
     io::Poll* poll_;
+    Notifier notifier_;
+    tbb::concurrent_queue<PostedMessage> posted_;
+    ServerStats stats_;
+    // End of the last Perform() and connections taken by handlers since.
+    uint64_t performed_;
+    size_t handled_;
+    BodySinkFactory::sptr body_sink_factory_;
+    ResponseCache::sptr response_cache_;
+    RequestCoalescer::sptr request_coalescer_;
+    MetricsExporter::sptr metrics_exporter_;
+    SlowRequestLog::sptr slow_request_log_;
     std::tr1::shared_ptr<threads::Thread<BaseListener> > listener_;
-    tbb::spin_mutex mutex_;
+    mutable tbb::spin_mutex mutex_;
   };
 
 
@@ -124,6 +192,7 @@ namespace webserver {
     ConnectionSet::iterator it = activity_.begin();
     c = std::tr1::dynamic_pointer_cast<T>(*it);
     activity_.erase(it);
+    ++handled_;
     return true;
   }
 
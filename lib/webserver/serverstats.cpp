@@ -0,0 +1,74 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "serverstats.h"
+
+#include <cstring>
+
+
+namespace webserver {
+
+  namespace {
+    const uint64_t MINUTE = 60 * 1000000000ULL;
+  }
+
+
+  ServerStats::ServerStats()
+  : minute_started_(0) {
+    for (size_t i = 0; i < COUNTERS_COUNT; ++i) {
+      counters_[i] = 0;
+    }
+    ::memset(percentiles_, 0, sizeof(percentiles_));
+  }
+
+
+  void ServerStats::Add(const Counter counter, const uint64_t value) {
+    // Single writer, no read-modify-write cycle is needed.
+    counters_[counter] = counters_[counter] + value;
+  }
+
+
+  void ServerStats::Set(const Counter counter, const uint64_t value) {
+    counters_[counter] = value;
+  }
+
+
+  void ServerStats::Record(const Distribution distribution, const uint64_t value) {
+    histograms_[distribution].Record(value);
+  }
+
+
+  void ServerStats::Tick(const uint64_t now) {
+    if (minute_started_ == 0) {
+      minute_started_ = now;
+      return;
+    }
+
+    if (now - minute_started_ < MINUTE) {
+      return;
+    }
+    minute_started_ = now;
+
+    LatencyPercentiles percentiles[DISTRIBUTIONS_COUNT];
+    for (size_t i = 0; i < DISTRIBUTIONS_COUNT; ++i) {
+      percentiles[i] = histograms_[i].Summarize();
+      histograms_[i].Clear();
+    }
+
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    ::memcpy(percentiles_, percentiles, sizeof(percentiles_));
+  }
+
+
+  uint64_t ServerStats::Get(const Counter counter) const {
+    return counters_[counter];
+  }
+
+
+  LatencyPercentiles ServerStats::GetPercentiles(const Distribution distribution) const {
+    tbb::spin_mutex::scoped_lock lock(percentiles_mutex_);
+    return percentiles_[distribution];
+  }
+
+} // namespace webserver
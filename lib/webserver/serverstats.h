@@ -0,0 +1,83 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_SERVER_STATS_H__
+#define WEBSERVER_SERVER_STATS_H__
+
+#include "latencyhistogram.h"
+
+#include <base/prototype.h>
+#include <cstddef>
+#include <inttypes.h>
+#include <tbb/atomic.h>
+#include <tbb/spin_mutex.h>
+
+
+namespace webserver {
+
+  //
+  // Event loop statistics of a server.
+  //
+  // Everything is recorded by server's thread: counters are single-writer atomics, which
+  // cost plain stores, and distributions go into histograms without locks. Once a minute
+  // histograms are summarized into percentiles for readers on other threads.
+  //
+
+  class ServerStats : public base::NonCopyable {
+  public:
+    typedef enum {
+      COUNTER_ITERATIONS,
+      COUNTER_EVENTS,
+      // Nanoseconds spent waiting in poll.
+      COUNTER_WAIT_TIME,
+      // Nanoseconds spent in Perform() besides waiting.
+      COUNTER_PERFORM_TIME,
+      // Nanoseconds spent by handlers between Perform() calls.
+      COUNTER_HANDLING_TIME,
+      // Syscalls changing the poll interest set, reading and writing sockets.
+      COUNTER_POLL_CONTROLS,
+      COUNTER_READS,
+      COUNTER_WRITES,
+      COUNTERS_COUNT
+    } Counter;
+
+    typedef enum {
+      // Events returned by a poll.
+      DISTRIBUTION_EVENTS,
+      // Microseconds per iteration, as counted above.
+      DISTRIBUTION_WAIT_TIME,
+      DISTRIBUTION_PERFORM_TIME,
+      DISTRIBUTION_HANDLING_TIME,
+      // Connections with activity queued for handlers once Perform() is done.
+      DISTRIBUTION_ACTIVITY,
+      // Active connections taken by handlers between Perform() calls.
+      DISTRIBUTION_HANDLED,
+      DISTRIBUTIONS_COUNT
+    } Distribution;
+
+    ServerStats();
+
+    void Add(const Counter counter, const uint64_t value = 1);
+    void Set(const Counter counter, const uint64_t value);
+    void Record(const Distribution distribution, const uint64_t value);
+    // Summarizes distributions once a minute has passed since they were last, time is in
+    // monotonic nanoseconds.
+    void Tick(const uint64_t now);
+
+    uint64_t Get(const Counter counter) const;
+    // Percentiles of the last complete minute.
+    LatencyPercentiles GetPercentiles(const Distribution distribution) const;
+
+  private:
+    tbb::atomic<uint64_t> counters_[COUNTERS_COUNT];
+    LatencyHistogram histograms_[DISTRIBUTIONS_COUNT];
+    uint64_t minute_started_;
+
+    mutable tbb::spin_mutex percentiles_mutex_;
+    LatencyPercentiles percentiles_[DISTRIBUTIONS_COUNT];
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_SERVER_STATS_H__
@@ -0,0 +1,134 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "sharedstatus.h"
+
+#include <cstring>
+
+extern "C" {
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+}
+
+
+namespace webserver {
+
+  namespace {
+    // Reader gives up after this many torn copies in a row.
+    const unsigned int MAX_READ_ATTEMPTS = 1000;
+  }
+
+
+  SharedStatus::SharedStatus()
+  : layout_(0) { }
+
+
+  SharedStatus::~SharedStatus() {
+    Close();
+  }
+
+
+  bool SharedStatus::Create(const std::string& path) {
+    Close();
+
+    const int fd = ::open(path.c_str(), O_RDWR | O_CREAT, 0644);
+    if (fd < 0) {
+      return false;
+    }
+
+    if (::ftruncate(fd, sizeof(SharedStatusLayout)) != 0 || !Map_(fd, true)) {
+      ::close(fd);
+      return false;
+    }
+    ::close(fd);
+
+    ::memset(layout_, 0, sizeof(SharedStatusLayout));
+    layout_->version = SHARED_STATUS_VERSION;
+    layout_->length = sizeof(SharedStatusLayout);
+    __sync_synchronize();
+    layout_->magic = SHARED_STATUS_MAGIC;
+    return true;
+  }
+
+
+  bool SharedStatus::Open(const std::string& path) {
+    Close();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd < 0) {
+      return false;
+    }
+
+    struct stat info;
+    if (::fstat(fd, &info) != 0 || static_cast<size_t>(info.st_size) != sizeof(SharedStatusLayout) || !Map_(fd, false)) {
+      ::close(fd);
+      return false;
+    }
+    ::close(fd);
+
+    if (layout_->magic != SHARED_STATUS_MAGIC || layout_->version != SHARED_STATUS_VERSION ||
+        layout_->length != sizeof(SharedStatusLayout)) {
+      Close();
+      return false;
+    }
+
+    return true;
+  }
+
+
+  void SharedStatus::Close() {
+    if (layout_) {
+      ::munmap(layout_, sizeof(SharedStatusLayout));
+      layout_ = 0;
+    }
+  }
+
+
+  bool SharedStatus::IsOpen() const {
+    return layout_ != 0;
+  }
+
+
+  void SharedStatus::Publish(const SharedStatusData& data) {
+    ++layout_->sequence;
+    __sync_synchronize();
+    ::memcpy(&layout_->data, &data, sizeof(SharedStatusData));
+    __sync_synchronize();
+    ++layout_->sequence;
+  }
+
+
+  bool SharedStatus::Read(SharedStatusData& data) const {
+    for (unsigned int i = 0; i < MAX_READ_ATTEMPTS; ++i) {
+      const uint32_t sequence = layout_->sequence;
+      if (sequence & 1) {
+        continue;
+      }
+
+      __sync_synchronize();
+      ::memcpy(&data, &layout_->data, sizeof(SharedStatusData));
+      __sync_synchronize();
+
+      if (layout_->sequence == sequence) {
+        return true;
+      }
+    }
+
+    return false;
+  }
+
+
+  bool SharedStatus::Map_(const int fd, const bool is_writer) {
+    void* map = ::mmap(0, sizeof(SharedStatusLayout), is_writer ? PROT_READ | PROT_WRITE : PROT_READ, MAP_SHARED, fd, 0);
+    if (map == MAP_FAILED) {
+      return false;
+    }
+
+    layout_ = static_cast<SharedStatusLayout*>(map);
+    return true;
+  }
+
+} // namespace webserver
@@ -0,0 +1,111 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_SHARED_STATUS_H__
+#define WEBSERVER_SHARED_STATUS_H__
+
+#include "connectionstats.h"
+#include "httptypes.h"
+#include "latencyhistogram.h"
+#include "requestphases.h"
+
+#include <base/prototype.h>
+#include <cstddef>
+#include <inttypes.h>
+#include <string>
+
+
+namespace webserver {
+
+  const uint32_t SHARED_STATUS_MAGIC = 0x54535357; // "WSST"
+  const uint32_t SHARED_STATUS_VERSION = 4;
+  const size_t SHARED_STATUS_MAX_ROUTES = 64;
+  // Longer route prefixes are truncated.
+  const size_t SHARED_STATUS_PREFIX_LENGTH = 64;
+
+  typedef struct {
+    char prefix[SHARED_STATUS_PREFIX_LENGTH];
+    uint64_t requests;
+    uint64_t responses[HTTP_CODES_COUNT];
+    uint64_t traffic_in;
+    uint64_t traffic_out;
+    LatencyPercentiles latency;
+  } SharedRouteStatus;
+
+  // Indexed by LatencyWindows::Window where there are 1, 5 and 15-minute values.
+  typedef struct {
+    // Seconds since the Epoch.
+    uint64_t updated;
+    uint64_t responses[HTTP_CODES_COUNT];
+    uint64_t traffic_in;
+    uint64_t traffic_out;
+    uint32_t sustained_rate[LatencyWindows::WINDOWS_COUNT];
+    uint32_t exponential_rate[LatencyWindows::WINDOWS_COUNT];
+    uint32_t attained_rate[LatencyWindows::WINDOWS_COUNT];
+    uint32_t max_attained_rate;
+    uint32_t latency[LatencyWindows::WINDOWS_COUNT];
+    uint32_t max_latency;
+    LatencyPercentiles latency_percentiles[LatencyWindows::WINDOWS_COUNT];
+    // Latencies of the last minute, see LatencyHistogram::GetBucketLimit().
+    uint64_t latency_histogram[LatencyHistogram::BUCKETS_COUNT];
+    // Time spent in request phases, indexed by RequestPhase.
+    LatencyPercentiles phase_percentiles[PHASES_COUNT][LatencyWindows::WINDOWS_COUNT];
+    // Incoming connections, closes are indexed by CloseReason and rates are per second.
+    uint64_t connections_accepted;
+    uint64_t connections_closed[CLOSE_REASONS_COUNT];
+    uint32_t accept_rate;
+    uint32_t close_rate[CLOSE_REASONS_COUNT];
+    uint64_t connection_requests;
+    uint64_t reused_requests;
+    LatencyPercentiles requests_per_connection;
+    // In milliseconds.
+    LatencyPercentiles connection_age;
+    uint32_t routes_count;
+    SharedRouteStatus routes[SHARED_STATUS_MAX_ROUTES];
+  } SharedStatusData;
+
+  typedef struct {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t length;
+    // Odd while data is being written.
+    volatile uint32_t sequence;
+    SharedStatusData data;
+  } SharedStatusLayout;
+
+
+  //
+  // Status snapshot in a file mapped to memory, normally under /dev/shm.
+  //
+  // Single writer publishes snapshots under a sequence lock: sequence is made odd before
+  // data is changed and even after. Readers copy data between two reads of an even and
+  // unchanged sequence, so they get consistent snapshots without syscalls or locks and
+  // never hold the writer up, however often they poll.
+  //
+
+  class SharedStatus : public base::NonCopyable {
+  public:
+    SharedStatus();
+    ~SharedStatus();
+
+    // Creates or truncates file and maps it for writing.
+    bool Create(const std::string& path);
+    // Maps existing file for reading, returns false if it is not a status of this version.
+    bool Open(const std::string& path);
+    void Close();
+    bool IsOpen() const;
+
+    void Publish(const SharedStatusData& data);
+    // Returns false if writer kept changing data through all attempts.
+    bool Read(SharedStatusData& data) const;
+
+  private:
+    bool Map_(const int fd, const bool is_writer);
+
+    SharedStatusLayout* layout_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_SHARED_STATUS_H__
@@ -0,0 +1,82 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "slidingwindows.h"
+
+#include <cmath>
+#include <cstring>
+
+
+namespace webserver {
+
+  namespace {
+    const size_t WINDOW_LENGTHS[SlidingWindows::WINDOWS_COUNT] = { 60, 300, 900 };
+
+    // Weight of past average after a second, exp(-1 / length).
+    const double DECAYS[SlidingWindows::WINDOWS_COUNT] = {
+      0.9834714538216175,
+      0.9966722160545233,
+      0.9988895059442793
+    };
+  }
+
+
+  const size_t SlidingWindows::HISTORY_LENGTH;
+
+
+  SlidingWindows::SlidingWindows()
+  : position_(0)
+  , size_(0) {
+    ::memset(values_, 0, sizeof(values_));
+    ::memset(sums_, 0, sizeof(sums_));
+
+    for (size_t i = 0; i < WINDOWS_COUNT; ++i) {
+      exponential_[i] = 0.0;
+    }
+  }
+
+
+  void SlidingWindows::Push(const uint64_t value) {
+    for (size_t i = 0; i < WINDOWS_COUNT; ++i) {
+      // Value leaving the window is the one pushed window length ago.
+      if (size_ >= WINDOW_LENGTHS[i]) {
+        sums_[i] -= values_[(position_ + HISTORY_LENGTH - WINDOW_LENGTHS[i]) % HISTORY_LENGTH];
+      }
+      sums_[i] += value;
+
+      exponential_[i] = size_ == 0 ? static_cast<double>(value) :
+        exponential_[i] * DECAYS[i] + static_cast<double>(value) * (1.0 - DECAYS[i]);
+    }
+
+    values_[position_] = value;
+    if (++position_ == HISTORY_LENGTH) {
+      position_ = 0;
+    }
+    if (size_ < HISTORY_LENGTH) {
+      ++size_;
+    }
+  }
+
+
+  uint64_t SlidingWindows::GetSum(const Window window) const {
+    return sums_[window];
+  }
+
+
+  size_t SlidingWindows::GetSize(const Window window) const {
+    return size_ < WINDOW_LENGTHS[window] ? size_ : WINDOW_LENGTHS[window];
+  }
+
+
+  unsigned int SlidingWindows::GetAverage(const Window window) const {
+    const size_t size = GetSize(window);
+    return size ? static_cast<unsigned int>(sums_[window] / size) : 0;
+  }
+
+
+  unsigned int SlidingWindows::GetExponentialAverage(const Window window) const {
+    return static_cast<unsigned int>(::floor(exponential_[window] + 0.5));
+  }
+
+} // namespace webserver
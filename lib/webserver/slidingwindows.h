@@ -0,0 +1,53 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_SLIDING_WINDOWS_H__
+#define WEBSERVER_SLIDING_WINDOWS_H__
+
+#include <cstddef>
+#include <inttypes.h>
+
+
+namespace webserver {
+
+  //
+  // Per-second values of the last 15 minutes.
+  //
+  // Values are kept in a ring with running sums over the last 1, 5 and 15 minutes, so every
+  // push and every average costs the same however long the windows are. Exponentially
+  // weighted averages with 1, 5 and 15-minute time constants are kept along.
+  //
+
+  class SlidingWindows {
+  public:
+    typedef enum {
+      WINDOW_1,
+      WINDOW_5,
+      WINDOW_15,
+      WINDOWS_COUNT
+    } Window;
+
+    static const size_t HISTORY_LENGTH = 900;
+
+    SlidingWindows();
+
+    void Push(const uint64_t value);
+
+    uint64_t GetSum(const Window window) const;
+    // Amount of values in window, less than its length until history fills up.
+    size_t GetSize(const Window window) const;
+    unsigned int GetAverage(const Window window) const;
+    unsigned int GetExponentialAverage(const Window window) const;
+
+  private:
+    uint64_t values_[HISTORY_LENGTH];
+    size_t position_;
+    size_t size_;
+    uint64_t sums_[WINDOWS_COUNT];
+    double exponential_[WINDOWS_COUNT];
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_SLIDING_WINDOWS_H__
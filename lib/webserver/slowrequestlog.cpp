@@ -0,0 +1,219 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "slowrequestlog.h"
+
+#include <cstring>
+#include <sstream>
+
+
+namespace webserver {
+
+  namespace {
+    // Phase duration of entries which did not go through phase.
+    const unsigned int NOT_REACHED = 0xffffffff;
+    // Writer sleeps this long between flushes, in milliseconds.
+    const int FLUSH_INTERVAL = 100;
+
+
+    // Appends as much of value as fits into zero-terminated buffer of length, returns its new use.
+    size_t AppendTruncated(char* to, size_t used, const size_t length, const char* value, const size_t value_length) {
+      const size_t copied = used + value_length < length ? value_length : length - used - 1;
+      ::memcpy(to + used, value, copied);
+      to[used + copied] = '\0';
+      return used + copied;
+    }
+  }
+
+
+  SlowRequestWriter::SlowRequestWriter()
+  : log_(0) { }
+
+
+  void SlowRequestWriter::SetLog(SlowRequestLog* log) {
+    log_ = log;
+  }
+
+
+  void SlowRequestWriter::Run() {
+    while (!ShouldStop()) {
+      log_->Flush();
+      Wait(FLUSH_INTERVAL);
+    }
+
+    log_->Flush();
+  }
+
+
+  const size_t SlowRequestLog::MAX_URI_LENGTH;
+  const size_t SlowRequestLog::MAX_HEADERS_LENGTH;
+
+
+  SlowRequestLog::SlowRequestLog(const unsigned int threshold, const unsigned int sampling, const size_t capacity)
+  : threshold_(threshold)
+  , sampling_(sampling != 0 ? sampling : 1)
+  , mask_(0)
+  , slots_(0)
+  , head_(0)
+  , logger_(log4cpp::Category::getInstance("slowrequests"))
+  , writer_(0) {
+    size_t size = 1;
+    while (size < capacity) {
+      size <<= 1;
+    }
+    mask_ = size - 1;
+
+    slots_ = new Slot[size];
+    for (size_t i = 0; i < size; ++i) {
+      slots_[i].sequence = i;
+    }
+
+    tail_ = 0;
+    requests_ = 0;
+    logged_ = 0;
+    dropped_ = 0;
+
+    writer_ = new threads::Thread<SlowRequestWriter>(false);
+    writer_->SetLog(this);
+    writer_->Start();
+    // Writer stopped before it runs would never see it.
+    while (!writer_->IsActive()) {
+      threads::Yield();
+    }
+  }
+
+
+  SlowRequestLog::~SlowRequestLog() {
+    writer_->Stop();
+    writer_->Join();
+    delete writer_;
+    delete[] slots_;
+  }
+
+
+  void SlowRequestLog::AddHeader(const std::string& name) {
+    headers_.push_back(name);
+  }
+
+
+  bool SlowRequestLog::Sample() {
+    return sampling_ == 1 || requests_.fetch_and_increment() % sampling_ == 0;
+  }
+
+
+  void SlowRequestLog::Capture(const IncomingHttpMessage& request, Entry& entry) const {
+    entry.method = request.GetMethod();
+
+    const std::string& uri = request.GetUri();
+    AppendTruncated(entry.uri, 0, MAX_URI_LENGTH, uri.data(), uri.size());
+
+    size_t used = 0;
+    entry.headers[0] = '\0';
+    for (std::vector<std::string>::const_iterator i = headers_.begin(); i != headers_.end(); ++i) {
+      IncomingHttpMessage::HttpPair header;
+      if (!request.FindHeader(i->c_str(), header)) {
+        continue;
+      }
+
+      if (used != 0) {
+        used = AppendTruncated(entry.headers, used, MAX_HEADERS_LENGTH, "; ", 2);
+      }
+      used = AppendTruncated(entry.headers, used, MAX_HEADERS_LENGTH, i->data(), i->size());
+      used = AppendTruncated(entry.headers, used, MAX_HEADERS_LENGTH, ": ", 2);
+      used = AppendTruncated(entry.headers, used, MAX_HEADERS_LENGTH, header->value.data(), header->value.size());
+    }
+  }
+
+
+  void SlowRequestLog::Record(const Entry& request, const OutgoingHttpMessage& response, const RequestPhases& phases) {
+    const uint64_t start = phases.Get(PHASE_FIRST_BYTE) != 0 ? phases.Get(PHASE_FIRST_BYTE) : phases.Get(PHASE_PARSED);
+    const uint64_t end = phases.Get(PHASE_WRITTEN);
+    if (start == 0 || end < start || (end - start) / 1000 < threshold_) {
+      return;
+    }
+
+    // Slot is claimed by moving tail past it, as long as reader is done with it.
+    uint64_t position = tail_;
+    Slot* slot;
+    while (true) {
+      slot = &slots_[position & mask_];
+      const uint64_t sequence = slot->sequence;
+
+      if (sequence == position) {
+        const uint64_t previous = tail_.compare_and_swap(position + 1, position);
+        if (previous == position) {
+          break;
+        }
+        position = previous;
+      }
+      else if (sequence < position) {
+        ++dropped_;
+        return;
+      }
+      else {
+        position = tail_;
+      }
+    }
+
+    Entry& entry = slot->entry;
+    entry = request;
+    entry.code = response.GetResponseCode();
+    entry.length = response.GetLength();
+    entry.latency = static_cast<unsigned int>((end - start) / 1000);
+
+    entry.phases[PHASE_ACCEPTED] = NOT_REACHED;
+    for (size_t i = PHASE_FIRST_BYTE; i < PHASES_COUNT; ++i) {
+      const RequestPhase phase = static_cast<RequestPhase>(i);
+      const bool is_reached = phases.Get(phase) != 0 && phases.Get(static_cast<RequestPhase>(i - 1)) != 0;
+      entry.phases[i] = is_reached ? static_cast<unsigned int>(phases.GetDuration(phase) / 1000) : NOT_REACHED;
+    }
+
+    slot->sequence = position + 1;
+  }
+
+
+  void SlowRequestLog::Flush() {
+    while (true) {
+      Slot& slot = slots_[head_ & mask_];
+      if (slot.sequence != head_ + 1) {
+        return;
+      }
+
+      Write_(slot.entry);
+      slot.sequence = head_ + mask_ + 1;
+      ++head_;
+      ++logged_;
+    }
+  }
+
+
+  uint64_t SlowRequestLog::GetLogged() const {
+    return logged_;
+  }
+
+
+  uint64_t SlowRequestLog::GetDropped() const {
+    return dropped_;
+  }
+
+
+  void SlowRequestLog::Write_(const Entry& entry) {
+    std::ostringstream line;
+    line << HTTP_METHODS[entry.method] << " " << entry.uri << " " << HTTP_CODES[entry.code][HTTP_CODE]
+         << " " << entry.length << " bytes in " << entry.latency << "us:";
+
+    for (size_t i = PHASE_FIRST_BYTE; i < PHASES_COUNT; ++i) {
+      if (entry.phases[i] != NOT_REACHED) {
+        line << " " << PHASE_NAMES[i] << "=" << entry.phases[i];
+      }
+    }
+
+    if (entry.headers[0] != '\0') {
+      line << " [" << entry.headers << "]";
+    }
+
+    logger_.warn(line.str());
+  }
+
+} // namespace webserver
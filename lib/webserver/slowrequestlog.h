@@ -0,0 +1,121 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_SLOW_REQUEST_LOG_H__
+#define WEBSERVER_SLOW_REQUEST_LOG_H__
+
+#include "httptypes.h"
+#include "incominghttpmessage.h"
+#include "outgoinghttpmessage.h"
+#include "requestphases.h"
+
+#include <base/prototype.h>
+#include <cstddef>
+#include <inttypes.h>
+#include <log4cpp/Category.hh>
+#include <string>
+#include <tbb/atomic.h>
+#include <threads/thread.h>
+#include <tr1/memory>
+#include <vector>
+
+
+namespace webserver {
+
+  class SlowRequestLog;
+
+  // Background thread writing out entries of a slow request log.
+  class SlowRequestWriter : public threads::Worker {
+  public:
+    SlowRequestWriter();
+
+    void SetLog(SlowRequestLog* log);
+    void Run();
+
+  private:
+    SlowRequestLog* log_;
+  };
+
+
+  //
+  // Log of requests which took longer than threshold, from their first byte read to the last
+  // byte of response written.
+  //
+  // One in every sampling requests is followed: its method, URI and selected headers are
+  // captured into an entry kept by its connection, which follows one request at a time. If
+  // the request turns out slow once its response is written, the entry is completed with
+  // time spent in phases and response size and copied into a slot of a lock-free ring,
+  // nothing is allocated or formatted on server's thread. Writer thread formats entries
+  // into the "slowrequests" log category. Entries coming while the ring is full are dropped
+  // and counted.
+  //
+  // Headers are set up before the log is given to servers, log may be shared by servers.
+  //
+
+  class SlowRequestLog : public base::NonCopyable {
+  public:
+    typedef std::tr1::shared_ptr<SlowRequestLog> sptr;
+
+    static const size_t MAX_URI_LENGTH = 256;
+    static const size_t MAX_HEADERS_LENGTH = 256;
+
+    typedef struct {
+      HttpMethod method;
+      HttpCode code;
+      uint64_t length;
+      // Microseconds in total and spent in phases, indexed by RequestPhase.
+      unsigned int latency;
+      unsigned int phases[PHASES_COUNT];
+      // Truncated to fit, zero-terminated.
+      char uri[MAX_URI_LENGTH];
+      char headers[MAX_HEADERS_LENGTH];
+    } Entry;
+
+    // Threshold is in microseconds, capacity of the ring is rounded up to a power of two.
+    SlowRequestLog(const unsigned int threshold, const unsigned int sampling = 1, const size_t capacity = 1024);
+    ~SlowRequestLog();
+
+    void AddHeader(const std::string& name);
+
+    // Called once for every request, returns true if request is to be followed.
+    bool Sample();
+    // Copies method, URI and headers of followed request into entry, once request is parsed.
+    void Capture(const IncomingHttpMessage& request, Entry& entry) const;
+    // Called for followed requests once response is written, with entry captured before.
+    void Record(const Entry& request, const OutgoingHttpMessage& response, const RequestPhases& phases);
+    // Writes out entries queued so far, called by writer thread.
+    void Flush();
+
+    uint64_t GetLogged() const;
+    uint64_t GetDropped() const;
+
+  private:
+    typedef struct {
+      // Equals position for a free slot and position + 1 for a filled one.
+      tbb::atomic<uint64_t> sequence;
+      Entry entry;
+    } Slot;
+
+    void Write_(const Entry& entry);
+
+    const unsigned int threshold_;
+    const unsigned int sampling_;
+    std::vector<std::string> headers_;
+
+    size_t mask_;
+    Slot* slots_;
+    tbb::atomic<uint64_t> tail_;
+    uint64_t head_;
+
+    tbb::atomic<unsigned int> requests_;
+    tbb::atomic<uint64_t> logged_;
+    tbb::atomic<uint64_t> dropped_;
+
+    log4cpp::Category& logger_;
+    threads::Thread<SlowRequestWriter>* writer_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_SLOW_REQUEST_LOG_H__
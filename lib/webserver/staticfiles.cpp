@@ -0,0 +1,543 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "staticfiles.h"
+#include "commonheaders.h"
+#include "compressor.h"
+#include "filebody.h"
+
+#include <base/c_format.h>
+#include <base/exception.h>
+#include <cerrno>
+#include <cstdlib>
+#include <cstring>
+#include <cstring/cstring.h>
+#include <ctime>
+
+extern "C" {
+#include <fcntl.h>
+#include <strings.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#ifdef OS_LINUX
+#include <sys/inotify.h>
+#endif
+}
+
+
+namespace webserver {
+
+  namespace {
+    const char* const CONTENT_TYPES[][2] = {
+      { "html", "text/html; charset=utf-8" },
+      { "htm", "text/html; charset=utf-8" },
+      { "css", "text/css; charset=utf-8" },
+      { "js", "application/javascript; charset=utf-8" },
+      { "json", "application/json" },
+      { "txt", "text/plain; charset=utf-8" },
+      { "xml", "application/xml" },
+      { "svg", "image/svg+xml" },
+      { "png", "image/png" },
+      { "jpg", "image/jpeg" },
+      { "jpeg", "image/jpeg" },
+      { "gif", "image/gif" },
+      { "ico", "image/x-icon" },
+      { "webp", "image/webp" },
+      { "woff", "font/woff" },
+      { "woff2", "font/woff2" },
+      { "wasm", "application/wasm" },
+      { "pdf", "application/pdf" }
+    };
+
+    // Entry bookkeeping besides strings and data.
+    const size_t ENTRY_OVERHEAD = 128;
+
+    void Trim(const char*& begin, const char*& end) {
+      while (begin < end && (*begin == ' ' || *begin == '\t')) {
+        ++begin;
+      }
+
+      while (end > begin && (end[-1] == ' ' || end[-1] == '\t')) {
+        --end;
+      }
+    }
+  }
+
+
+  StaticFiles::StaticFiles(const std::string& root)
+  : root_(root.size() > 1 && root[root.size() - 1] == '/' ? root.substr(0, root.size() - 1) : root)
+  , index_("index.html")
+  , memory_budget_(64 * 1024 * 1024)
+  , max_cached_file_size_(1024 * 1024)
+  , memory_(0)
+  , poll_(0) { }
+
+
+  StaticFiles::~StaticFiles() {
+    Close();
+  }
+
+
+  bool StaticFiles::Open(io::Poll* poll) {
+#ifdef OS_LINUX
+    const int fd = ::inotify_init();
+    if (fd == -1) {
+      return false;
+    }
+
+    if (::fcntl(fd, F_SETFL, ::fcntl(fd, F_GETFL) | O_NONBLOCK) != 0) {
+      ::close(fd);
+      return false;
+    }
+
+    {
+      // Entries cached so far were not watched.
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      cache_.clear();
+      lru_.clear();
+      memory_ = 0;
+      fd_ = fd;
+    }
+
+    poll_ = poll;
+    SetState(STATE_CONNECTED);
+    poll_->Open(this);
+    poll_->InsertRead(this);
+    return true;
+#else
+    static_cast<void>(poll);
+    return false;
+#endif
+  }
+
+
+  void StaticFiles::Close() {
+    if (fd_ == -1) {
+      return;
+    }
+
+    SetState(STATE_CLOSING);
+    poll_->RemoveRead(this);
+    poll_->Close(this);
+
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    ::close(fd_);
+    fd_ = -1;
+    watches_.clear();
+    directories_.clear();
+  }
+
+
+  void StaticFiles::SetMemoryBudget(const size_t budget) {
+    memory_budget_ = budget;
+  }
+
+
+  void StaticFiles::SetMaxCachedFileSize(const size_t size) {
+    max_cached_file_size_ = size;
+  }
+
+
+  void StaticFiles::SetIndex(const std::string& index) {
+    index_ = index;
+  }
+
+
+  OutgoingHttpMessage::sptr StaticFiles::Serve(const IncomingHttpMessage::sptr& request, const bool is_persistent) {
+    if (request->GetMethod() != GET && request->GetMethod() != HEAD) {
+      return OutgoingHttpMessage::sptr();
+    }
+
+    std::string path;
+    if (!ResolvePath_(request->GetUri(), path)) {
+      return OutgoingHttpMessage::NotFound(is_persistent);
+    }
+
+    path = root_ + path;
+    if (path[path.size() - 1] == '/') {
+      path.append(index_);
+    }
+
+    EntryPtr entry;
+    if (Compressor::Accepts(*request, Compressor::GZIP)) {
+      entry = Lookup_(path + ".gz");
+    }
+
+    if (!entry || !entry->exists) {
+      entry = Lookup_(path);
+    }
+
+    if (!entry->exists) {
+      return OutgoingHttpMessage::NotFound(is_persistent);
+    }
+
+    OutgoingHttpMessage::sptr response = OutgoingHttpMessage::sptr(new OutgoingHttpMessage(request->GetTimer()));
+    response->SetMethod(RESPONSE);
+    response->SetPersistence(is_persistent);
+    response->AddHeaders(entry->headers);
+
+    if (IsNotModified_(*request, *entry)) {
+      response->SetResponseCode(HTTP_NOT_MODIFIED);
+      return response;
+    }
+
+    response->SetResponseCode(HTTP_OK);
+    response->SetHeadOnly(request->GetMethod() == HEAD);
+
+    if (entry->data) {
+      response->SetData(entry->data);
+    }
+    else if (request->GetMethod() == HEAD) {
+      response->SetBorrowedData(0, static_cast<size_t>(entry->size));
+    }
+    else {
+      try {
+        response->SetData(FileBody::Open(entry->path));
+      }
+      catch (const IOException&) {
+        Invalidate_(entry->path);
+        return OutgoingHttpMessage::NotFound(is_persistent);
+      }
+    }
+
+    return response;
+  }
+
+
+  void StaticFiles::EventRead() {
+#ifdef OS_LINUX
+    char buffer[4096] __attribute__ ((aligned(__alignof__(inotify_event))));
+    ssize_t len;
+
+    while ((len = ::read(fd_, buffer, sizeof(buffer))) > 0) {
+      for (char* p = buffer; p < buffer + len; ) {
+        const inotify_event* event = reinterpret_cast<const inotify_event*>(p);
+        p += sizeof(inotify_event) + event->len;
+
+        if (event->mask & IN_Q_OVERFLOW) {
+          tbb::spin_mutex::scoped_lock lock(mutex_);
+          cache_.clear();
+          lru_.clear();
+          memory_ = 0;
+          continue;
+        }
+
+        std::string directory;
+        {
+          tbb::spin_mutex::scoped_lock lock(mutex_);
+          std::map<int, std::string>::iterator i = directories_.find(event->wd);
+          if (i == directories_.end()) {
+            continue;
+          }
+
+          directory = i->second;
+          if (event->mask & IN_IGNORED) {
+            watches_.erase(directory);
+            directories_.erase(i);
+          }
+        }
+
+        if (event->mask & (IN_IGNORED | IN_DELETE_SELF | IN_MOVE_SELF)) {
+          InvalidateDirectory_(directory);
+        }
+        else if (event->len != 0) {
+          Invalidate_(directory + "/" + event->name);
+        }
+      }
+    }
+#endif
+  }
+
+
+  void StaticFiles::EventWrite() { }
+
+
+  void StaticFiles::EventError() { }
+
+
+  StaticFiles::EntryPtr StaticFiles::Lookup_(const std::string& path) {
+    bool is_watched;
+    {
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      is_watched = fd_ != -1;
+
+      Cache::iterator i = cache_.find(path);
+      if (i != cache_.end()) {
+        lru_.splice(lru_.begin(), lru_, i->second.second);
+        if (is_watched) {
+          return i->second.first;
+        }
+
+        EntryPtr entry = i->second.first;
+        lock.release();
+
+        if (IsFresh_(*entry)) {
+          return entry;
+        }
+      }
+    }
+
+    // Watch is added before file is examined, so changes made meanwhile are not missed.
+    // Files in directories which cannot be watched are not cached at all.
+    const bool is_cacheable = !is_watched || Watch_(path);
+
+    EntryPtr entry = Load_(path);
+    if (is_cacheable) {
+      Insert_(entry);
+    }
+    return entry;
+  }
+
+
+  StaticFiles::EntryPtr StaticFiles::Load_(const std::string& path) const {
+    std::tr1::shared_ptr<Entry> entry = std::tr1::shared_ptr<Entry>(new Entry());
+    entry->exists = false;
+    entry->path = path;
+    entry->modified = 0;
+    entry->size = 0;
+    entry->inode = 0;
+    entry->cost = ENTRY_OVERHEAD + 2 * path.size();
+
+    const int fd = ::open(path.c_str(), O_RDONLY);
+    if (fd == -1) {
+      return entry;
+    }
+
+    struct stat st;
+    if (::fstat(fd, &st) != 0 || !S_ISREG(st.st_mode)) {
+      ::close(fd);
+      return entry;
+    }
+
+    entry->modified = st.st_mtime;
+    entry->size = st.st_size;
+    entry->inode = st.st_ino;
+
+    if (static_cast<size_t>(st.st_size) <= max_cached_file_size_) {
+      const size_t size = static_cast<size_t>(st.st_size);
+      char* data = new char[size > 0 ? size : 1];
+      size_t read = 0;
+
+      while (read < size) {
+        const ssize_t r = ::pread(fd, data + read, size - read, static_cast<off_t>(read));
+        if (r < 0 && errno == EINTR) {
+          continue;
+        }
+        if (r <= 0) {
+          break;
+        }
+        read += static_cast<size_t>(r);
+      }
+
+      if (read != size) {
+        delete[] data;
+        ::close(fd);
+        return entry;
+      }
+
+      entry->data = Blob::Adopt(data, size);
+      entry->cost += size;
+    }
+
+    ::close(fd);
+
+    char modified[CommonHeaders::HTTP_DATE_LENGTH + 1];
+    modified[CommonHeaders::FormatDate(entry->modified, modified)] = 0;
+
+    entry->etag = c_format("\"%lx-%lx-%lx\"", static_cast<unsigned long>(entry->inode),
+                           static_cast<unsigned long>(entry->size), static_cast<unsigned long>(entry->modified));
+
+    const bool is_gzip = path.size() > 3 && path.compare(path.size() - 3, 3, ".gz") == 0;
+    entry->headers.append("Content-Type: ");
+    entry->headers.append(ContentType_(is_gzip ? path.substr(0, path.size() - 3) : path));
+    entry->headers.append("\r\nETag: ");
+    entry->headers.append(entry->etag);
+    entry->headers.append("\r\nLast-Modified: ");
+    entry->headers.append(modified);
+    entry->headers.append("\r\nVary: Accept-Encoding\r\n");
+    if (is_gzip) {
+      entry->headers.append("Content-Encoding: gzip\r\n");
+    }
+
+    entry->cost += entry->headers.size();
+    entry->exists = true;
+    return entry;
+  }
+
+
+  bool StaticFiles::IsFresh_(const Entry& entry) const {
+    struct stat st;
+    if (::stat(entry.path.c_str(), &st) != 0 || !S_ISREG(st.st_mode)) {
+      return !entry.exists;
+    }
+
+    return entry.exists && st.st_mtime == entry.modified && st.st_size == entry.size && st.st_ino == entry.inode;
+  }
+
+
+  void StaticFiles::Insert_(const EntryPtr& entry) {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+
+    Cache::iterator i = cache_.find(entry->path);
+    if (i != cache_.end()) {
+      memory_ -= i->second.first->cost;
+      i->second.first = entry;
+      lru_.splice(lru_.begin(), lru_, i->second.second);
+    }
+    else if (entry->cost <= memory_budget_) {
+      lru_.push_front(entry->path);
+      cache_.insert(std::make_pair(entry->path, CacheItem(entry, lru_.begin())));
+    }
+    else {
+      return;
+    }
+
+    memory_ += entry->cost;
+
+    while (memory_ > memory_budget_ && !lru_.empty()) {
+      Cache::iterator victim = cache_.find(lru_.back());
+      memory_ -= victim->second.first->cost;
+      cache_.erase(victim);
+      lru_.pop_back();
+    }
+  }
+
+
+  void StaticFiles::Invalidate_(const std::string& path) {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+
+    Cache::iterator i = cache_.find(path);
+    if (i == cache_.end()) {
+      return;
+    }
+
+    memory_ -= i->second.first->cost;
+    lru_.erase(i->second.second);
+    cache_.erase(i);
+  }
+
+
+  void StaticFiles::InvalidateDirectory_(const std::string& directory) {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+
+    const std::string prefix = directory + "/";
+    for (Cache::iterator i = cache_.lower_bound(prefix); i != cache_.end() && i->first.compare(0, prefix.size(), prefix) == 0; ) {
+      memory_ -= i->second.first->cost;
+      lru_.erase(i->second.second);
+      cache_.erase(i++);
+    }
+  }
+
+
+  bool StaticFiles::Watch_(const std::string& path) {
+#ifdef OS_LINUX
+    const std::string directory = path.substr(0, path.rfind('/'));
+
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    if (fd_ == -1) {
+      return false;
+    }
+
+    if (watches_.find(directory) != watches_.end()) {
+      return true;
+    }
+
+    const int wd = ::inotify_add_watch(fd_, directory.empty() ? "/" : directory.c_str(),
+                                       IN_CLOSE_WRITE | IN_MODIFY | IN_ATTRIB | IN_CREATE | IN_DELETE |
+                                       IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF);
+    if (wd == -1) {
+      return false;
+    }
+
+    watches_[directory] = wd;
+    directories_[wd] = directory;
+    return true;
+#else
+    static_cast<void>(path);
+    return false;
+#endif
+  }
+
+
+  bool StaticFiles::IsNotModified_(const IncomingHttpMessage& request, const Entry& entry) const {
+    IncomingHttpMessage::HttpPair header;
+
+    // Entity tags take precedence over modification date.
+    if (request.FindHeader("if-none-match", header)) {
+      const char* p = header->value.c_str();
+      const char* const end = p + header->value.size();
+
+      while (p < end) {
+        const char* comma = static_cast<const char*>(::memchr(p, ',', end - p));
+        const char* tag_end = comma ? comma : end;
+        const char* tag = p;
+        Trim(tag, tag_end);
+
+        if (tag_end - tag > 2 && ::strncmp(tag, "W/", 2) == 0) {
+          tag += 2;
+        }
+
+        if ((tag_end - tag == 1 && *tag == '*') ||
+            entry.etag.compare(0, std::string::npos, tag, tag_end - tag) == 0) {
+          return true;
+        }
+
+        p = comma ? comma + 1 : end;
+      }
+
+      return false;
+    }
+
+    if (request.FindHeader("if-modified-since", header)) {
+      tm since;
+      ::memset(&since, 0, sizeof(since));
+      if (::strptime(header->value.c_str(), "%a, %d %b %Y %H:%M:%S GMT", &since) != 0) {
+        return entry.modified <= ::timegm(&since);
+      }
+    }
+
+    return false;
+  }
+
+
+  bool StaticFiles::ResolvePath_(const std::string& uri, std::string& path) {
+    const size_t end = uri.find_first_of("?#");
+    base::CString decoded(uri.substr(0, end));
+    decoded.UrlDecode();
+    path.assign(decoded.Str(), decoded.Length());
+
+    if (path.empty() || path[0] != '/' || path.find('\0') != std::string::npos) {
+      return false;
+    }
+
+    // No way out of the root.
+    for (size_t slash = 0; slash != std::string::npos; slash = path.find('/', slash + 1)) {
+      const size_t next = path.find('/', slash + 1);
+      const size_t len = (next == std::string::npos ? path.size() : next) - slash - 1;
+      if ((len == 1 || len == 2) && path.compare(slash + 1, len, "..", len) == 0) {
+        return false;
+      }
+    }
+
+    return true;
+  }
+
+
+  const char* StaticFiles::ContentType_(const std::string& path) {
+    const size_t dot = path.rfind('.');
+    const size_t slash = path.rfind('/');
+
+    if (dot != std::string::npos && (slash == std::string::npos || dot > slash)) {
+      const char* extension = path.c_str() + dot + 1;
+      for (size_t i = 0; i < sizeof(CONTENT_TYPES) / sizeof(CONTENT_TYPES[0]); ++i) {
+        if (::strcasecmp(extension, CONTENT_TYPES[i][0]) == 0) {
+          return CONTENT_TYPES[i][1];
+        }
+      }
+    }
+
+    return "application/octet-stream";
+  }
+
+} // namespace webserver
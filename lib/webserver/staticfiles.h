@@ -0,0 +1,116 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_STATIC_FILES_H__
+#define WEBSERVER_STATIC_FILES_H__
+
+#include "blob.h"
+#include "incominghttpmessage.h"
+#include "outgoinghttpmessage.h"
+
+#include <io/event.h>
+#include <io/poll.h>
+#include <list>
+#include <map>
+#include <string>
+#include <tbb/spin_mutex.h>
+#include <tr1/memory>
+
+extern "C" {
+#include <sys/types.h>
+}
+
+
+namespace webserver {
+
+  //
+  // Static files handler.
+  //
+  // Answers GET and HEAD requests with files under the root directory. Recently served
+  // files are kept in a memory-bounded LRU cache with their response headers formatted
+  // in advance, small files together with their contents; larger ones are sent from disk
+  // with sendfile(). Clients accepting gzip get "file.gz" instead of "file" when it exists.
+  // Requests carrying matching If-None-Match or If-Modified-Since are answered with 304.
+  //
+  // Once opened in server's poll, handler watches directories of cached files with inotify
+  // and drops entries when files change. Otherwise cached files are checked with stat() on
+  // every hit.
+  //
+  // Serve() may be called from any thread.
+  //
+
+  class StaticFiles : public io::Event {
+  public:
+    typedef std::tr1::shared_ptr<StaticFiles> sptr;
+
+    explicit StaticFiles(const std::string& root);
+    ~StaticFiles();
+
+    // Starts watching for changes, returns false if notifications are not available.
+    bool Open(io::Poll* poll);
+    void Close();
+
+    // Total size of cached entries, 64MB by default.
+    void SetMemoryBudget(const size_t budget);
+    // Larger files are not held in memory, 1MB by default.
+    void SetMaxCachedFileSize(const size_t size);
+    // Served for directory requests, "index.html" by default.
+    void SetIndex(const std::string& index);
+
+    // Returns empty pointer for other methods, so request may be handled otherwise.
+    OutgoingHttpMessage::sptr Serve(const IncomingHttpMessage::sptr& request, const bool is_persistent);
+
+    void EventRead();
+    void EventWrite();
+    void EventError();
+
+  private:
+    typedef struct {
+      bool exists;
+      std::string path;
+      // Pre-formatted Content-Type, ETag, Last-Modified, Content-Encoding and Vary lines.
+      std::string headers;
+      std::string etag;
+      time_t modified;
+      off_t size;
+      ino_t inode;
+      // File contents, empty for files above cached size.
+      Blob::sptr data;
+      size_t cost;
+    } Entry;
+
+    typedef std::tr1::shared_ptr<const Entry> EntryPtr;
+    typedef std::list<std::string> LruList;
+    typedef std::pair<EntryPtr, LruList::iterator> CacheItem;
+    typedef std::map<std::string, CacheItem> Cache;
+
+    EntryPtr Lookup_(const std::string& path);
+    EntryPtr Load_(const std::string& path) const;
+    bool IsFresh_(const Entry& entry) const;
+    void Insert_(const EntryPtr& entry);
+    void Invalidate_(const std::string& path);
+    void InvalidateDirectory_(const std::string& directory);
+    bool Watch_(const std::string& path);
+    bool IsNotModified_(const IncomingHttpMessage& request, const Entry& entry) const;
+
+    static bool ResolvePath_(const std::string& uri, std::string& path);
+    static const char* ContentType_(const std::string& path);
+
+    const std::string root_;
+    std::string index_;
+    size_t memory_budget_;
+    size_t max_cached_file_size_;
+
+    tbb::spin_mutex mutex_;
+    Cache cache_;
+    LruList lru_;
+    size_t memory_;
+    std::map<std::string, int> watches_;
+    std::map<int, std::string> directories_;
+    io::Poll* poll_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_STATIC_FILES_H__
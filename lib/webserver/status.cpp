@@ -7,21 +7,37 @@
 #include <base/basicmacros.h>
 #include <base/string_helpers.h>
 #include <cmath>
+#include <cstring>
+#include <ctime>
 #include <iomanip>
-#include <numeric>
 #include <sstream>
 
 
 namespace webserver {
 
+  const size_t WebserverStatus::MAX_ROUTES;
+  const size_t WebserverStatus::NO_ROUTE;
+
+
+  WebserverStatus::Route::Route() {
+    requests = 0;
+    for (size_t i = 0; i < HTTP_CODES_COUNT; ++i) {
+      responses[i] = 0;
+    }
+    traffic_in = 0;
+    traffic_out = 0;
+    ::memset(&latency, 0, sizeof(latency));
+  }
+
+
   WebserverStatus::WebserverStatus() :
     http_served_(webserver::HTTP_CODES_COUNT, 0), 
-    sustained_rate_position_(0), 
-    attained_rate_position_(0),
-    latency_position_(0),
     sustained_rate_1_(0), 
     sustained_rate_5_(0),
     sustained_rate_15_(0),
+    exponential_rate_1_(0),
+    exponential_rate_5_(0),
+    exponential_rate_15_(0),
     max_attained_rate_(0),
     attained_rate_1_(0),
     attained_rate_5_(0),
@@ -29,7 +45,9 @@ namespace webserver {
     latency_1_(0),
     latency_5_(0),
     latency_15_(0),
-    total_served_requests_(0) 
+    total_served_requests_(0),
+    route_seconds_(0),
+    shared_data_(0)
   {
     traffic_in_ = 0;
     traffic_out_ = 0;
@@ -37,10 +55,13 @@ namespace webserver {
     fast_latency_sum_ = 0;
     fast_latency_count_ = 0;
     max_latency_ = 0;
+    routes_count_ = 0;
+    is_shared_ = false;
   }
 
 
   WebserverStatus::~WebserverStatus() { 
+    delete shared_data_;
   }
 
 
@@ -49,19 +70,30 @@ namespace webserver {
   }
 
 
-  void WebserverStatus::ServedRequest(const OutgoingHttpMessage::sptr& message) {
-    http_served_[message->GetResponseCode()]++;
-    traffic_out_ += message->GetLength();
+  void WebserverStatus::ServedRequest(const OutgoingHttpMessage::sptr& message, const size_t route) {
+    const HttpCode code = message->GetResponseCode();
+    const size_t length = message->GetLength();
+    http_served_[code]++;
+    traffic_out_ += length;
+
+    Route* r = route < routes_count_ ? &routes_[route] : 0;
+    if (r) {
+      ++r->responses[code];
+      r->traffic_out += length;
+    }
 
-    clocks::HiResTimer* t = message->GetTimer();
-    if (t) {
-      t->Mark();
-      double nanoDifference = static_cast<double>(t->GetDifferenceNanoseconds());
-      unsigned int latency = static_cast<unsigned int>(t->GetDifferenceSeconds()) * 1000000 +
-        static_cast<unsigned int>(::round(nanoDifference / 1000));
+    const clocks::Timestamp& received = message->GetTimer();
+    if (received.IsSet()) {
+      const uint64_t nanoseconds = received.NanosecondsTo(clocks::Timestamp::Now());
+      unsigned int latency = static_cast<unsigned int>((nanoseconds + 500) / 1000);
       fast_latency_sum_.fetch_and_add(latency);
       ++fast_latency_count_;
       ++outgoing_rate_;
+      latency_windows_.Record(latency);
+
+      if (r) {
+        r->recorder.Record(latency);
+      }
 
       if (latency > max_latency_ && max_attained_rate_ != 0) {
         max_latency_ = latency;
@@ -105,6 +137,21 @@ namespace webserver {
   }
 
 
+  unsigned int WebserverStatus::ExponentialRate1() const {
+    return exponential_rate_1_;
+  }
+
+
+  unsigned int WebserverStatus::ExponentialRate5() const {
+    return exponential_rate_5_;
+  }
+
+
+  unsigned int WebserverStatus::ExponentialRate15() const {
+    return exponential_rate_15_;
+  }
+
+
   unsigned int WebserverStatus::AttainedRate1() const {
     return attained_rate_1_;
   }
@@ -145,107 +192,161 @@ namespace webserver {
   }
 
 
-  void WebserverStatus::Run() {
-    while (!ShouldStop()) {
-      const unsigned int rate = outgoing_rate_;
-      outgoing_rate_ -= rate;
-      max_attained_rate_ = max_attained_rate_ < rate ? rate : max_attained_rate_;
-      CalculateSustainedRate_(rate);
-      CalculateAttainedRate_(rate);
-      CalculateLatency_();
-      CalculateRequests_();
-      Wait(1000);
-    }
+  LatencyPercentiles WebserverStatus::LatencyPercentiles1() const {
+    return latency_windows_.GetPercentiles(LatencyWindows::WINDOW_1);
   }
 
 
-  void WebserverStatus::CalculateSustainedRate_(const unsigned int rate) {
-    size_t size_1 = 60;
-    size_t size_5 = 300;
-    size_t size_15 = 900;
+  LatencyPercentiles WebserverStatus::LatencyPercentiles5() const {
+    return latency_windows_.GetPercentiles(LatencyWindows::WINDOW_5);
+  }
 
-    if (sustained_rate_1_history_.size() < 60) {
-      sustained_rate_1_history_.push_back(rate);
-      size_1 = sustained_rate_1_history_.size();
-    }
-    else {
-      sustained_rate_1_history_[sustained_rate_position_ % 60] = rate;
-    }
 
-    if (sustained_rate_5_history_.size() < 300) {
-      sustained_rate_5_history_.push_back(rate);
-      size_5 = sustained_rate_5_history_.size();
-    }
-    else {
-      sustained_rate_5_history_[sustained_rate_position_ % 300] = rate;
-    }
+  LatencyPercentiles WebserverStatus::LatencyPercentiles15() const {
+    return latency_windows_.GetPercentiles(LatencyWindows::WINDOW_15);
+  }
 
-    if (sustained_rate_15_history_.size() < 900) {
-      sustained_rate_15_history_.push_back(rate);
-      size_15 = sustained_rate_15_history_.size();
-    }
-    else {
-      sustained_rate_15_history_[sustained_rate_position_] = rate;
-    }
 
-    if (++sustained_rate_position_ >= 900) {
-      sustained_rate_position_ = 0;
+  void WebserverStatus::TimedRequest(const RequestPhases& phases) {
+    for (size_t i = PHASE_FIRST_BYTE; i < PHASES_COUNT; ++i) {
+      const RequestPhase phase = static_cast<RequestPhase>(i);
+      if (phases.Get(phase) != 0 && phases.Get(static_cast<RequestPhase>(i - 1)) != 0) {
+        phase_windows_[i].Record((phases.GetDuration(phase) + 500) / 1000);
+      }
     }
+  }
 
-    const float acc_rate_1 = static_cast<float>(std::accumulate(sustained_rate_1_history_.begin(), sustained_rate_1_history_.end(), 0));
-    const float acc_rate_5 = static_cast<float>(std::accumulate(sustained_rate_5_history_.begin(), sustained_rate_5_history_.end(), 0));
-    const float acc_rate_15 = static_cast<float>(std::accumulate(sustained_rate_15_history_.begin(), sustained_rate_15_history_.end(), 0));
 
-    sustained_rate_1_ = static_cast<unsigned int>(acc_rate_1 / static_cast<float>(size_1));
-    sustained_rate_5_ = static_cast<unsigned int>(acc_rate_5 / static_cast<float>(size_5));
-    sustained_rate_15_ = static_cast<unsigned int>(acc_rate_15 / static_cast<float>(size_15));
+  LatencyPercentiles WebserverStatus::PhasePercentiles(const RequestPhase phase, const LatencyWindows::Window window) const {
+    return phase_windows_[phase].GetPercentiles(window);
   }
 
 
-  void WebserverStatus::CalculateAttainedRate_(const unsigned int rate) {
-    if (rate == 0) {
-      return;
+  bool WebserverStatus::AddRoute(const std::string& uri_prefix) {
+    if (routes_count_ >= MAX_ROUTES) {
+      return false;
     }
 
-    size_t size_1 = 60;
-    size_t size_5 = 300;
-    size_t size_15 = 900;
+    // Slot is filled in before it is counted, so lookups never see it half-done.
+    routes_[routes_count_].prefix = uri_prefix;
+    ++routes_count_;
+    return true;
+  }
+
 
-    if (attained_rate_1_history_.size() < 60) {
-      attained_rate_1_history_.push_back(rate);
-      size_1 = attained_rate_1_history_.size();
-    }
-    else {
-      attained_rate_1_history_[attained_rate_position_ % 60] = rate;
+  size_t WebserverStatus::GetRoutesCount() const {
+    return routes_count_;
+  }
+
+
+  size_t WebserverStatus::FindRoute(const std::string& uri) const {
+    const size_t count = routes_count_;
+    size_t route = NO_ROUTE;
+    size_t matched = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      const std::string& prefix = routes_[i].prefix;
+      if (prefix.size() >= matched && uri.compare(0, prefix.size(), prefix) == 0) {
+        matched = prefix.size();
+        route = i;
+      }
     }
 
-    if (attained_rate_5_history_.size() < 300) {
-      attained_rate_5_history_.push_back(rate);
-      size_5 = attained_rate_5_history_.size();
+    return route;
+  }
+
+
+  void WebserverStatus::RoutedRequest(const size_t route, const size_t length) {
+    if (route < routes_count_) {
+      ++routes_[route].requests;
+      routes_[route].traffic_in += length;
     }
-    else {
-      attained_rate_5_history_[attained_rate_position_ % 300] = rate;
+  }
+
+
+  WebserverStatus::RouteStats WebserverStatus::GetRouteStats(const size_t route) const {
+    const Route& r = routes_[route];
+
+    RouteStats stats;
+    stats.prefix = r.prefix;
+    stats.requests = r.requests;
+    for (size_t i = 0; i < HTTP_CODES_COUNT; ++i) {
+      stats.responses[i] = r.responses[i];
     }
+    stats.traffic_in = r.traffic_in;
+    stats.traffic_out = r.traffic_out;
+
+    tbb::spin_mutex::scoped_lock lock(routes_mutex_);
+    stats.latency = r.latency;
+    return stats;
+  }
+
 
-    if (attained_rate_15_history_.size() < 900) {
-      attained_rate_15_history_.push_back(rate);
-      size_15 = attained_rate_15_history_.size();
+  ConnectionStats& WebserverStatus::GetConnectionStats() {
+    return connection_stats_;
+  }
+
+
+  const ConnectionStats& WebserverStatus::GetConnectionStats() const {
+    return connection_stats_;
+  }
+
+
+  bool WebserverStatus::PublishTo(const std::string& path) {
+    if (!shared_status_.Create(path)) {
+      return false;
     }
-    else {
-      attained_rate_15_history_[attained_rate_position_] = rate;
+
+    shared_data_ = new SharedStatusData();
+    is_shared_ = true;
+    return true;
+  }
+
+
+  void WebserverStatus::Run() {
+    while (!ShouldStop()) {
+      const unsigned int rate = outgoing_rate_;
+      outgoing_rate_ -= rate;
+      max_attained_rate_ = max_attained_rate_ < rate ? rate : max_attained_rate_;
+      CalculateSustainedRate_(rate);
+      CalculateAttainedRate_(rate);
+      CalculateLatency_();
+      latency_windows_.Tick();
+      for (size_t i = PHASE_FIRST_BYTE; i < PHASES_COUNT; ++i) {
+        phase_windows_[i].Tick();
+      }
+      CalculateRequests_();
+      CalculateRoutes_();
+      connection_stats_.Tick();
+      Publish_();
+      Wait(1000);
     }
+  }
 
-    if (++attained_rate_position_ >= 900) {
-      attained_rate_position_ = 0;
+
+  void WebserverStatus::CalculateSustainedRate_(const unsigned int rate) {
+    sustained_rates_.Push(rate);
+
+    sustained_rate_1_ = sustained_rates_.GetAverage(SlidingWindows::WINDOW_1);
+    sustained_rate_5_ = sustained_rates_.GetAverage(SlidingWindows::WINDOW_5);
+    sustained_rate_15_ = sustained_rates_.GetAverage(SlidingWindows::WINDOW_15);
+
+    exponential_rate_1_ = sustained_rates_.GetExponentialAverage(SlidingWindows::WINDOW_1);
+    exponential_rate_5_ = sustained_rates_.GetExponentialAverage(SlidingWindows::WINDOW_5);
+    exponential_rate_15_ = sustained_rates_.GetExponentialAverage(SlidingWindows::WINDOW_15);
+  }
+
+
+  void WebserverStatus::CalculateAttainedRate_(const unsigned int rate) {
+    if (rate == 0) {
+      return;
     }
 
-    const float acc_rate_1 = static_cast<float>(std::accumulate(attained_rate_1_history_.begin(), attained_rate_1_history_.end(), 0));
-    const float acc_rate_5 = static_cast<float>(std::accumulate(attained_rate_5_history_.begin(), attained_rate_5_history_.end(), 0));
-    const float acc_rate_15 = static_cast<float>(std::accumulate(attained_rate_15_history_.begin(), attained_rate_15_history_.end(), 0));
+    attained_rates_.Push(rate);
 
-    attained_rate_1_ = static_cast<unsigned int>(acc_rate_1 / static_cast<float>(size_1));
-    attained_rate_5_ = static_cast<unsigned int>(acc_rate_5 / static_cast<float>(size_15));
-    attained_rate_15_ = static_cast<unsigned int>(acc_rate_15 / static_cast<float>(size_15));
+    attained_rate_1_ = attained_rates_.GetAverage(SlidingWindows::WINDOW_1);
+    attained_rate_5_ = attained_rates_.GetAverage(SlidingWindows::WINDOW_5);
+    attained_rate_15_ = attained_rates_.GetAverage(SlidingWindows::WINDOW_15);
   }
 
 
@@ -256,41 +357,11 @@ namespace webserver {
       fast_latency_count_ = 0;
 
       if (average > 0) {
-        size_t size_1 = 60;
-        size_t size_5 = 300;
-        size_t size_15 = 900;
-
-        if (latency_1_history_.size() < 60) {
-          latency_1_history_.push_back(average);
-          size_1 = latency_1_history_.size();
-        }
-        else {
-          latency_1_history_[latency_position_ % 60] = average;
-        }
-
-        if (latency_5_history_.size() < 300) {
-          latency_5_history_.push_back(average);
-          size_5 = latency_5_history_.size();
-        }
-        else {
-          latency_5_history_[latency_position_ % 300] = average;
-        }
-
-        if (latency_15_history_.size() < 900) {
-          latency_15_history_.push_back(average);
-          size_15 = latency_15_history_.size();
-        }
-        else {
-          latency_15_history_[latency_position_] = average;
-        }
-
-        if (++latency_position_ >= 900) {
-          latency_position_ = 0;
-        }
-
-        latency_1_ = static_cast<unsigned int>(std::accumulate(latency_1_history_.begin(), latency_1_history_.end(), 0.0) / static_cast<float>(size_1));
-        latency_5_ = static_cast<unsigned int>(std::accumulate(latency_5_history_.begin(), latency_5_history_.end(), 0.0) / static_cast<float>(size_5));
-        latency_15_ = static_cast<unsigned int>(std::accumulate(latency_15_history_.begin(), latency_15_history_.end(), 0.0) / static_cast<float>(size_15));
+        latencies_.Push(static_cast<uint64_t>(::round(average)));
+
+        latency_1_ = latencies_.GetAverage(SlidingWindows::WINDOW_1);
+        latency_5_ = latencies_.GetAverage(SlidingWindows::WINDOW_5);
+        latency_15_ = latencies_.GetAverage(SlidingWindows::WINDOW_15);
       }
     }
   }
@@ -303,4 +374,96 @@ namespace webserver {
     }
   }
 
+
+  void WebserverStatus::CalculateRoutes_() {
+    const size_t count = routes_count_;
+    for (size_t i = 0; i < count; ++i) {
+      routes_[i].recorder.Drain(routes_[i].minute);
+    }
+
+    if (++route_seconds_ < 60) {
+      return;
+    }
+    route_seconds_ = 0;
+
+    for (size_t i = 0; i < count; ++i) {
+      const LatencyPercentiles latency = routes_[i].minute.Summarize();
+      routes_[i].minute.Clear();
+
+      tbb::spin_mutex::scoped_lock lock(routes_mutex_);
+      routes_[i].latency = latency;
+    }
+  }
+
+
+  void WebserverStatus::Publish_() {
+    if (!is_shared_) {
+      return;
+    }
+
+    SharedStatusData& data = *shared_data_;
+    ::memset(&data, 0, sizeof(data));
+    data.updated = static_cast<uint64_t>(::time(0));
+
+    for (size_t i = 0; i < HTTP_CODES_COUNT; ++i) {
+      data.responses[i] = http_served_[i];
+    }
+    data.traffic_in = traffic_in_;
+    data.traffic_out = traffic_out_;
+
+    const unsigned int sustained[] = { sustained_rate_1_, sustained_rate_5_, sustained_rate_15_ };
+    const unsigned int exponential[] = { exponential_rate_1_, exponential_rate_5_, exponential_rate_15_ };
+    const unsigned int attained[] = { attained_rate_1_, attained_rate_5_, attained_rate_15_ };
+    const unsigned int latency[] = { latency_1_, latency_5_, latency_15_ };
+
+    for (size_t i = 0; i < LatencyWindows::WINDOWS_COUNT; ++i) {
+      data.sustained_rate[i] = sustained[i];
+      data.exponential_rate[i] = exponential[i];
+      data.attained_rate[i] = attained[i];
+      data.latency[i] = latency[i];
+      data.latency_percentiles[i] = latency_windows_.GetPercentiles(static_cast<LatencyWindows::Window>(i));
+    }
+    for (size_t i = 0; i < PHASES_COUNT; ++i) {
+      for (size_t j = 0; j < LatencyWindows::WINDOWS_COUNT; ++j) {
+        data.phase_percentiles[i][j] = phase_windows_[i].GetPercentiles(static_cast<LatencyWindows::Window>(j));
+      }
+    }
+    data.max_attained_rate = max_attained_rate_;
+    data.max_latency = max_latency_;
+
+    const LatencyHistogram& last_minute = latency_windows_.GetLastMinute();
+    for (size_t i = 0; i < LatencyHistogram::BUCKETS_COUNT; ++i) {
+      data.latency_histogram[i] = last_minute.GetBucketCount(i);
+    }
+
+    data.connections_accepted = connection_stats_.GetAccepted();
+    data.accept_rate = connection_stats_.AcceptRate();
+    for (size_t i = 0; i < CLOSE_REASONS_COUNT; ++i) {
+      const CloseReason reason = static_cast<CloseReason>(i);
+      data.connections_closed[i] = connection_stats_.GetClosed(reason);
+      data.close_rate[i] = connection_stats_.CloseRate(reason);
+    }
+    data.connection_requests = connection_stats_.GetRequests();
+    data.reused_requests = connection_stats_.GetReusedRequests();
+    data.requests_per_connection = connection_stats_.GetRequestsPerConnection();
+    data.connection_age = connection_stats_.GetAge();
+
+    data.routes_count = static_cast<uint32_t>(routes_count_);
+    for (size_t i = 0; i < data.routes_count; ++i) {
+      const RouteStats stats = GetRouteStats(i);
+      SharedRouteStatus& route = data.routes[i];
+
+      ::strncpy(route.prefix, stats.prefix.c_str(), SHARED_STATUS_PREFIX_LENGTH - 1);
+      route.requests = stats.requests;
+      for (size_t code = 0; code < HTTP_CODES_COUNT; ++code) {
+        route.responses[code] = stats.responses[code];
+      }
+      route.traffic_in = stats.traffic_in;
+      route.traffic_out = stats.traffic_out;
+      route.latency = stats.latency;
+    }
+
+    shared_status_.Publish(data);
+  }
+
 } // namespace webserver
@@ -5,8 +5,13 @@
 #ifndef WEBSERVER_STATUS_H__
 #define WEBSERVER_STATUS_H__
 
+#include "connectionstats.h"
 #include "httptypes.h"
+#include "latencyhistogram.h"
 #include "outgoinghttpmessage.h"
+#include "requestphases.h"
+#include "sharedstatus.h"
+#include "slidingwindows.h"
 
 #include <base/hash.tbb.h>
 #include <base/prototype.h>
@@ -15,6 +20,7 @@
 #include <string>
 #include <tbb/atomic.h>
 #include <tbb/concurrent_vector.h>
+#include <tbb/spin_mutex.h>
 #include <threads/singleton.h>
 #include <threads/thread.h>
 
@@ -25,11 +31,25 @@ namespace webserver {
   public:
     typedef tbb::concurrent_vector<uint64_t> HttpResponseTable;
 
+    static const size_t MAX_ROUTES = SHARED_STATUS_MAX_ROUTES;
+    // Route of requests matching none.
+    static const size_t NO_ROUTE = MAX_ROUTES;
+
+    typedef struct {
+      std::string prefix;
+      uint64_t requests;
+      uint64_t responses[HTTP_CODES_COUNT];
+      uint64_t traffic_in;
+      uint64_t traffic_out;
+      // Latencies of the last complete minute.
+      LatencyPercentiles latency;
+    } RouteStats;
+
     WebserverStatus();
     ~WebserverStatus();
 
     void IncomingRequest(const size_t length);
-    void ServedRequest(const OutgoingHttpMessage::sptr& message);
+    void ServedRequest(const OutgoingHttpMessage::sptr& message, const size_t route = NO_ROUTE);
     uint64_t TotalServedRequests() const;
     const HttpResponseTable& GetHttpServed() const;
 
@@ -39,6 +59,10 @@ namespace webserver {
     unsigned int SustainedRate1() const;
     unsigned int SustainedRate5() const;
     unsigned int SustainedRate15() const;
+    // Sustained rates averaged exponentially with 1, 5 and 15-minute time constants.
+    unsigned int ExponentialRate1() const;
+    unsigned int ExponentialRate5() const;
+    unsigned int ExponentialRate15() const;
 
     unsigned int MaxAttainedRate() const;
     unsigned int AttainedRate1() const;
@@ -50,26 +74,68 @@ namespace webserver {
     unsigned int Latency5() const;
     unsigned int Latency15() const;
 
+    // Percentiles of request latencies in microseconds.
+    LatencyPercentiles LatencyPercentiles1() const;
+    LatencyPercentiles LatencyPercentiles5() const;
+    LatencyPercentiles LatencyPercentiles15() const;
+
+    // Records time request spent in every phase it went through.
+    void TimedRequest(const RequestPhases& phases);
+    // Percentiles of time spent in phase in microseconds, see RequestPhase.
+    LatencyPercentiles PhasePercentiles(const RequestPhase phase, const LatencyWindows::Window window) const;
+
+    // Requests whose URI starts with prefix are counted for the route too, the longest prefix
+    // wins. Routes are added once status is initialized and before requests arrive, returns
+    // false once MAX_ROUTES are added.
+    bool AddRoute(const std::string& uri_prefix);
+    size_t GetRoutesCount() const;
+    size_t FindRoute(const std::string& uri) const;
+    void RoutedRequest(const size_t route, const size_t length);
+    RouteStats GetRouteStats(const size_t route) const;
+
+    ConnectionStats& GetConnectionStats();
+    const ConnectionStats& GetConnectionStats() const;
+
+    // Publishes status into file mapped to memory after every update, see SharedStatus.
+    // Called once, returns false if file cannot be created.
+    bool PublishTo(const std::string& path);
+
     void Run();
 
   private:
+    // Slots of all routes are allocated up front and updated without locks.
+    struct Route {
+      Route();
+
+      std::string prefix;
+      tbb::atomic<uint64_t> requests;
+      tbb::atomic<uint64_t> responses[HTTP_CODES_COUNT];
+      tbb::atomic<uint64_t> traffic_in;
+      tbb::atomic<uint64_t> traffic_out;
+      LatencyRecorder recorder;
+      LatencyHistogram minute;
+      LatencyPercentiles latency;
+    };
+
     void CalculateSustainedRate_(const unsigned int rate);
     void CalculateAttainedRate_(const unsigned int rate);
     void CalculateLatency_();
     void CalculateRequests_();
+    void CalculateRoutes_();
+    void Publish_();
 
     HttpResponseTable http_served_;
     tbb::atomic<uint64_t> traffic_in_;
     tbb::atomic<uint64_t> traffic_out_;
     tbb::atomic<unsigned int> outgoing_rate_;
-    unsigned int sustained_rate_position_;
-    unsigned int attained_rate_position_;
-    unsigned int latency_position_;
     tbb::atomic<unsigned int> max_latency_;
 
     unsigned int sustained_rate_1_;
     unsigned int sustained_rate_5_;
     unsigned int sustained_rate_15_;
+    unsigned int exponential_rate_1_;
+    unsigned int exponential_rate_5_;
+    unsigned int exponential_rate_15_;
 
     unsigned int max_attained_rate_;
     unsigned int attained_rate_1_;
@@ -81,20 +147,26 @@ namespace webserver {
     unsigned int latency_1_;
     unsigned int latency_5_;
     unsigned int latency_15_;
+    LatencyWindows latency_windows_;
+    // Accepted phase has no duration, its slot is left unused.
+    LatencyWindows phase_windows_[PHASES_COUNT];
 
     uint64_t total_served_requests_;
 
-    tbb::concurrent_vector<unsigned int> sustained_rate_1_history_;
-    tbb::concurrent_vector<unsigned int> sustained_rate_5_history_;
-    tbb::concurrent_vector<unsigned int> sustained_rate_15_history_;
+    SlidingWindows sustained_rates_;
+    SlidingWindows attained_rates_;
+    SlidingWindows latencies_;
+
+    ConnectionStats connection_stats_;
 
-    tbb::concurrent_vector<unsigned int> attained_rate_1_history_;
-    tbb::concurrent_vector<unsigned int> attained_rate_5_history_;
-    tbb::concurrent_vector<unsigned int> attained_rate_15_history_;
+    Route routes_[MAX_ROUTES];
+    tbb::atomic<size_t> routes_count_;
+    size_t route_seconds_;
+    mutable tbb::spin_mutex routes_mutex_;
 
-    tbb::concurrent_vector<float> latency_1_history_;
-    tbb::concurrent_vector<float> latency_5_history_;
-    tbb::concurrent_vector<float> latency_15_history_;
+    SharedStatus shared_status_;
+    SharedStatusData* shared_data_;
+    tbb::atomic<bool> is_shared_;
   };
 
   typedef threads::Singleton<WebserverStatus> Status;
@@ -0,0 +1,310 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#include "streaminghttpmessage.h"
+
+#include <algorithm>
+#include <cstring>
+
+
+namespace webserver {
+
+  namespace {
+    const size_t DEFAULT_HIGH_WATER_MARK = 256 * 1024;
+    const char CHUNK_END[] = "\r\n";
+    const size_t CHUNK_END_LENGTH = sizeof(CHUNK_END) - 1;
+    const char STREAM_END[] = "0\r\n\r\n";
+    const size_t STREAM_END_LENGTH = sizeof(STREAM_END) - 1;
+    const char HEX_DIGITS[] = "0123456789abcdef";
+
+
+    void AddPiece(iovec* segments, const size_t count, size_t& n, size_t& skip, const char* data, const size_t len) {
+      if (skip >= len) {
+        skip -= len;
+        return;
+      }
+
+      if (n < count) {
+        segments[n].iov_base = const_cast<char*>(data + skip);
+        segments[n].iov_len = len - skip;
+        ++n;
+      }
+      skip = 0;
+    }
+  }
+
+
+  StreamingHttpMessage::StreamingHttpMessage(const clocks::Timestamp* timer)
+  : OutgoingHttpMessage(timer)
+  , released_(0)
+  , queued_(0)
+  , written_(0)
+  , high_water_mark_(DEFAULT_HIGH_WATER_MARK)
+  , is_finished_(false)
+  , is_aborted_(false)
+  , is_over_mark_(false)
+  , is_waiting_(false) {
+    SetChunked_();
+  }
+
+
+  StreamingHttpMessage::~StreamingHttpMessage() { }
+
+
+  void StreamingHttpMessage::SetObserver(const StreamObserver::sptr& observer) {
+    observer_ = observer;
+  }
+
+
+  void StreamingHttpMessage::SetHighWaterMark(const size_t mark) {
+    high_water_mark_ = mark;
+  }
+
+
+  bool StreamingHttpMessage::Write(const char* data, const size_t len) {
+    if (len == 0) {
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      return !is_over_mark_ && !is_aborted_;
+    }
+
+    return Push_(Blob::Create(data, len), len);
+  }
+
+
+  bool StreamingHttpMessage::Write(const Blob::sptr& data) {
+    if (!data || data->Length() == 0) {
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      return !is_over_mark_ && !is_aborted_;
+    }
+
+    return Push_(data, data->Length());
+  }
+
+
+  void StreamingHttpMessage::Finish() {
+    Push_(Blob::sptr(), 0);
+  }
+
+
+  size_t StreamingHttpMessage::GetPending() const {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    return queued_ - written_;
+  }
+
+
+  bool StreamingHttpMessage::IsAborted() const {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    return is_aborted_;
+  }
+
+
+  void StreamingHttpMessage::SetHeadOnly(const bool is_head_only) {
+    // Producer checks the flag as it queues data.
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    OutgoingHttpMessage::SetHeadOnly(is_head_only);
+  }
+
+
+  void StreamingHttpMessage::SetCloseDelimited() {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    OutgoingHttpMessage::SetCloseDelimited();
+
+    // Message is not written yet, chunks queued so far drop their framing.
+    queued_ = 0;
+    for (std::deque<Chunk>::iterator i = chunks_.begin(); i != chunks_.end(); ++i) {
+      i->length = i->data ? i->data->Length() : 0;
+      queued_ += i->length;
+    }
+  }
+
+
+  size_t StreamingHttpMessage::GetSegments(const size_t offset, iovec* segments, const size_t count) const {
+    const size_t header_len = OutgoingHttpMessage::GetLength();
+    size_t n = 0;
+    size_t skip = 0;
+
+    if (offset < header_len) {
+      n = OutgoingHttpMessage::GetSegments(offset, segments, count);
+    }
+    else {
+      skip = offset - header_len;
+    }
+
+    if (IsHeadOnly()) {
+      return n;
+    }
+
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    const bool is_framed = !IsCloseDelimited();
+    skip -= std::min(skip, released_);
+
+    for (std::deque<Chunk>::const_iterator i = chunks_.begin(); i != chunks_.end() && n < count; ++i) {
+      if (skip >= i->length) {
+        skip -= i->length;
+        continue;
+      }
+
+      if (is_framed) {
+        AddPiece(segments, count, n, skip, i->prefix, i->prefix_len);
+      }
+      if (i->data) {
+        AddPiece(segments, count, n, skip, i->data->Data(), i->data->Length());
+        if (is_framed) {
+          AddPiece(segments, count, n, skip, CHUNK_END, CHUNK_END_LENGTH);
+        }
+      }
+    }
+
+    return n;
+  }
+
+
+  size_t StreamingHttpMessage::GetLength() const {
+    const size_t header_len = OutgoingHttpMessage::GetLength();
+
+    if (IsHeadOnly()) {
+      return header_len;
+    }
+
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    return header_len + queued_;
+  }
+
+
+  bool StreamingHttpMessage::IsComplete() const {
+    if (IsHeadOnly()) {
+      return true;
+    }
+
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    return is_finished_;
+  }
+
+
+  void StreamingHttpMessage::Attach(const BaseConnection::wptr& connection) {
+    tbb::spin_mutex::scoped_lock lock(mutex_);
+    connection_ = connection;
+  }
+
+
+  bool StreamingHttpMessage::Written(const size_t offset) {
+    const size_t header_len = OutgoingHttpMessage::GetLength();
+
+    if (offset < header_len || IsHeadOnly()) {
+      return true;
+    }
+
+    bool is_drained = false;
+    bool is_written = true;
+    {
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      written_ = offset - header_len;
+
+      while (!chunks_.empty() && released_ + chunks_.front().length <= written_) {
+        released_ += chunks_.front().length;
+        chunks_.pop_front();
+      }
+
+      if (written_ == queued_ && !is_finished_) {
+        is_waiting_ = true;
+        is_written = false;
+      }
+
+      if (is_over_mark_ && queued_ - written_ <= high_water_mark_ / 2) {
+        is_over_mark_ = false;
+        is_drained = true;
+      }
+    }
+
+    if (is_drained && observer_) {
+      observer_->OnDrain();
+    }
+
+    return is_written;
+  }
+
+
+  void StreamingHttpMessage::Abort() {
+    {
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      if (is_aborted_ || is_finished_) {
+        return;
+      }
+
+      is_aborted_ = true;
+      chunks_.clear();
+    }
+
+    if (observer_) {
+      observer_->OnAbort();
+    }
+  }
+
+
+  bool StreamingHttpMessage::Push_(const Blob::sptr& data, const size_t len) {
+    // Terminating chunk is queued with no data.
+    Chunk chunk;
+    chunk.data = data;
+
+    if (data) {
+      char digits[sizeof(size_t) * 2];
+      size_t digits_count = 0;
+      for (size_t left = len; left != 0; left >>= 4) {
+        digits[digits_count++] = HEX_DIGITS[left & 0xf];
+      }
+
+      chunk.prefix_len = 0;
+      while (digits_count != 0) {
+        chunk.prefix[chunk.prefix_len++] = digits[--digits_count];
+      }
+      chunk.prefix[chunk.prefix_len++] = '\r';
+      chunk.prefix[chunk.prefix_len++] = '\n';
+      chunk.length = chunk.prefix_len + len + CHUNK_END_LENGTH;
+    }
+    else {
+      std::memcpy(chunk.prefix, STREAM_END, STREAM_END_LENGTH);
+      chunk.prefix_len = STREAM_END_LENGTH;
+      chunk.length = STREAM_END_LENGTH;
+    }
+
+    BaseConnection::sptr connection;
+    bool is_accepted;
+    {
+      tbb::spin_mutex::scoped_lock lock(mutex_);
+      if (is_aborted_ || is_finished_) {
+        return false;
+      }
+
+      if (IsHeadOnly()) {
+        is_finished_ = !data;
+        return true;
+      }
+
+      if (IsCloseDelimited()) {
+        chunk.length = len;
+      }
+
+      chunks_.push_back(chunk);
+      queued_ += chunk.length;
+      is_finished_ = !data;
+
+      if (queued_ - written_ > high_water_mark_) {
+        is_over_mark_ = true;
+      }
+      is_accepted = !is_over_mark_;
+
+      if (is_waiting_) {
+        is_waiting_ = false;
+        connection = connection_.lock();
+      }
+    }
+
+    if (connection) {
+      connection->WakeWrite();
+    }
+
+    return is_accepted;
+  }
+
+} // namespace webserver
@@ -0,0 +1,108 @@
+// Embedded web-server library
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+
+#ifndef WEBSERVER_STREAMING_HTTP_MESSAGE_H__
+#define WEBSERVER_STREAMING_HTTP_MESSAGE_H__
+
+#include "baseconnection.h"
+#include "blob.h"
+#include "outgoinghttpmessage.h"
+
+#include <deque>
+#include <tbb/spin_mutex.h>
+#include <tr1/memory>
+
+
+namespace webserver {
+
+  // Notified on server's thread about state of a stream.
+  class StreamObserver {
+  public:
+    typedef std::tr1::shared_ptr<StreamObserver> sptr;
+
+    virtual ~StreamObserver() { }
+
+    // Queued data fell below the low-water mark, stream takes more.
+    virtual void OnDrain() = 0;
+    // Connection was closed before the stream was finished, further data is dropped.
+    virtual void OnAbort() { }
+  };
+
+
+  //
+  // Response with body sent as "Transfer-Encoding: chunked" stream.
+  //
+  // Message is sent as soon as it is passed to BaseConnection::SendMessage(), and handler
+  // keeps writing chunks from any thread while it is being sent. Each chunk is written as
+  // it is queued, without being joined with others. HTTP/1.0 clients get the chunks without
+  // framing, and the connection is closed after the last one.
+  //
+  // Write() returns false once queued data grows above the high-water mark: producer
+  // should stop and wait for StreamObserver::OnDrain().
+  //
+
+  class StreamingHttpMessage : public OutgoingHttpMessage {
+  public:
+    typedef std::tr1::shared_ptr<StreamingHttpMessage> sptr;
+
+    StreamingHttpMessage(const clocks::Timestamp* timer = 0);
+    ~StreamingHttpMessage();
+
+    void SetObserver(const StreamObserver::sptr& observer);
+    // Bytes queued and not yet written which stop the producer, 256KB by default. Drain is
+    // reported once half of them is written.
+    void SetHighWaterMark(const size_t mark);
+
+    // Queues data as one chunk. Returns false if the producer should wait for drain, or
+    // stop altogether when the stream is aborted.
+    bool Write(const char* data, const size_t len);
+    bool Write(const Blob::sptr& data);
+    // Terminates the stream.
+    void Finish();
+
+    size_t GetPending() const;
+    bool IsAborted() const;
+
+    void SetHeadOnly(const bool is_head_only);
+    void SetCloseDelimited();
+
+    size_t GetSegments(const size_t offset, iovec* segments, const size_t count) const;
+    size_t GetLength() const;
+    bool IsComplete() const;
+    void Attach(const BaseConnection::wptr& connection);
+    bool Written(const size_t offset);
+    void Abort();
+
+  private:
+    typedef struct {
+      // Chunk size line.
+      char prefix[20];
+      size_t prefix_len;
+      Blob::sptr data;
+      // Bytes the chunk takes in the stream, with framing unless close-delimited.
+      size_t length;
+    } Chunk;
+
+    bool Push_(const Blob::sptr& data, const size_t len);
+
+    mutable tbb::spin_mutex mutex_;
+    std::deque<Chunk> chunks_;
+    // Stream offset of the first queued chunk.
+    size_t released_;
+    // Stream bytes queued so far.
+    size_t queued_;
+    // Stream bytes written so far.
+    size_t written_;
+    size_t high_water_mark_;
+    bool is_finished_;
+    bool is_aborted_;
+    bool is_over_mark_;
+    bool is_waiting_;
+    BaseConnection::wptr connection_;
+    StreamObserver::sptr observer_;
+  };
+
+} // namespace webserver
+
+#endif // WEBSERVER_STREAMING_HTTP_MESSAGE_H__
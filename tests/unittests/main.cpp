@@ -0,0 +1,222 @@
+// Unit checks.
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+//
+// Checks pure parts of the library whose edge cases are easy to get wrong. Prints failed
+// checks and exits with non-zero status if there are any.
+
+#include <cstring/cstring.h>
+#include <webserver/chunkeddecoder.h>
+#include <webserver/exception.h>
+#include <webserver/headerbuilder.h>
+#include <webserver/incominghttpmessage.h>
+#include <webserver/latencyhistogram.h>
+#include <webserver/messagebody.h>
+#include <webserver/outgoinghttpmessage.h>
+
+#include <cstring>
+#include <iostream>
+#include <string>
+#include <vector>
+
+
+namespace {
+  unsigned int checks = 0;
+  unsigned int failures = 0;
+
+
+  void Check(const bool is_passed, const std::string& what) {
+    ++checks;
+    if (!is_passed) {
+      ++failures;
+      std::cerr << "FAILED: " << what << std::endl;
+    }
+  }
+
+
+  std::string Decimal(const uint64_t value) {
+    char digits[webserver::MAX_DECIMAL_LENGTH];
+    return std::string(digits, webserver::FormatDecimal(value, digits));
+  }
+
+
+  void CheckFormatDecimal() {
+    Check(Decimal(0) == "0", "FormatDecimal(0)");
+    Check(Decimal(9) == "9", "FormatDecimal(9)");
+    Check(Decimal(10) == "10", "FormatDecimal(10)");
+    Check(Decimal(99) == "99", "FormatDecimal(99)");
+    Check(Decimal(100) == "100", "FormatDecimal(100)");
+    Check(Decimal(0xffffffffffffffffULL) == "18446744073709551615", "FormatDecimal(UINT64_MAX)");
+  }
+
+
+  // Every value is counted in a bucket whose limit is not below it, and above the limit of
+  // the bucket before.
+  void CheckBucket(const uint64_t value) {
+    using webserver::LatencyHistogram;
+
+    const size_t bucket = LatencyHistogram::GetBucket(value);
+    const std::string what = "bucket of " + Decimal(value);
+    Check(bucket < LatencyHistogram::BUCKETS_COUNT, what + " is in range");
+    Check(LatencyHistogram::GetBucketLimit(bucket) >= value, what + " holds the value");
+    Check(bucket == 0 || LatencyHistogram::GetBucketLimit(bucket - 1) < value, what + " is the first to hold the value");
+  }
+
+
+  void CheckLatencyBuckets() {
+    using webserver::LatencyHistogram;
+
+    for (uint64_t value = 0; value < 4096; ++value) {
+      CheckBucket(value);
+    }
+    for (unsigned int bits = 6; bits < 32; ++bits) {
+      CheckBucket((1ULL << bits) - 1);
+      CheckBucket(1ULL << bits);
+      CheckBucket((1ULL << bits) + 1);
+    }
+
+    Check(LatencyHistogram::GetBucket(63) == 63, "value 63 has a bucket of its own");
+    Check(LatencyHistogram::GetBucket(64) == 64, "value 64 starts the first shared bucket");
+    Check(LatencyHistogram::GetBucket(128) == LatencyHistogram::GetBucket(127) + 1, "buckets of 127 and 128 are adjacent");
+
+    const size_t last = LatencyHistogram::GetBucket(LatencyHistogram::MAX_VALUE);
+    Check(last == LatencyHistogram::BUCKETS_COUNT - 1, "2^32-1 is in the last bucket");
+    Check(LatencyHistogram::GetBucketLimit(last) == LatencyHistogram::MAX_VALUE, "last bucket ends at 2^32-1");
+    Check(LatencyHistogram::GetBucket(LatencyHistogram::MAX_VALUE + 1) == last, "larger values are counted in the last bucket");
+    Check(LatencyHistogram::GetBucket(0xffffffffffffffffULL) == last, "UINT64_MAX is counted in the last bucket");
+  }
+
+
+  // Feeds body in pieces of given lengths, the last one takes the rest.
+  bool DecodeChunked(const std::string& data, const size_t* pieces, const size_t count, std::string& decoded, size_t& consumed) {
+    webserver::ChunkedDecoder decoder;
+    webserver::MessageBody body;
+    size_t offset = 0;
+    consumed = 0;
+
+    for (size_t i = 0; i <= count && offset < data.size(); ++i) {
+      const size_t len = i < count && pieces[i] < data.size() - offset ? pieces[i] : data.size() - offset;
+      consumed += decoder.Decode(data.data() + offset, len, body);
+      offset += len;
+    }
+
+    decoded.assign(body.Data(), body.Length());
+    return decoder.IsDone();
+  }
+
+
+  void CheckChunkedDecoder() {
+    const std::string body = "4;name=value\r\nWiki\r\n5\r\npedia\r\nE\r\n in\r\n\r\nchunks.\r\n0\r\nTrailer: x\r\n\r\n";
+    const std::string expected = "Wikipedia in\r\n\r\nchunks.";
+    std::string decoded;
+    size_t consumed;
+
+    Check(DecodeChunked(body, 0, 0, decoded, consumed) && decoded == expected, "chunked body in one piece");
+
+    // Every split point, so sizes, extensions, CRLFs and trailers are cut everywhere.
+    for (size_t split = 1; split < body.size(); ++split) {
+      const bool is_done = DecodeChunked(body, &split, 1, decoded, consumed);
+      Check(is_done && decoded == expected && consumed == body.size(), "chunked body split at " + Decimal(split));
+    }
+
+    std::vector<size_t> bytes(body.size(), 1);
+    Check(DecodeChunked(body, &bytes[0], bytes.size(), decoded, consumed) && decoded == expected, "chunked body fed byte by byte");
+
+    Check(DecodeChunked(body + "GET / HTTP/1.1\r\n", 0, 0, decoded, consumed) && consumed == body.size(),
+          "decoding stops after the terminating empty line");
+    Check(DecodeChunked("1a\r\nabcdefghijklmnopqrstuvwxyz\r\n0\r\n\r\n", 0, 0, decoded, consumed) && decoded.size() == 26,
+          "hexadecimal chunk size");
+
+    bool is_thrown = false;
+    try {
+      DecodeChunked("zz\r\nab\r\n0\r\n\r\n", 0, 0, decoded, consumed);
+    }
+    catch (const webserver::DeserializationError&) {
+      is_thrown = true;
+    }
+    Check(is_thrown, "invalid chunk size is refused");
+  }
+
+
+  void CheckQuery(const char* query, const char* const* pairs, const size_t count) {
+    base::QueryTokenizer tokenizer(query, ::strlen(query));
+    std::string key;
+    std::string value;
+
+    for (size_t i = 0; i < count; ++i) {
+      const bool is_found = tokenizer.Next(key, value);
+      Check(is_found && key == pairs[2 * i] && value == pairs[2 * i + 1],
+            std::string("query ") + query + " pair " + pairs[2 * i]);
+    }
+    Check(!tokenizer.Next(key, value), std::string("query ") + query + " ends");
+  }
+
+
+  void CheckQueryTokenizer() {
+    const char* const plain[] = { "a", "1", "b", "two" };
+    CheckQuery("?a=1&b=two", plain, 2);
+
+    const char* const decoded[] = { "name", "John Smith", "path", "/a b/", "eq", "x=y" };
+    CheckQuery("name=John+Smith&path=%2Fa%20b%2f&eq=x=y", decoded, 3);
+
+    // Pairs without key or value are skipped, invalid escapes are kept as they are.
+    const char* const malformed[] = { "bad", "%zz", "cut", "%4" };
+    CheckQuery("flag&=1&bad=%zz&empty=&cut=%4", malformed, 2);
+
+    CheckQuery("", 0, 0);
+    CheckQuery("?", 0, 0);
+  }
+
+
+  std::string SerializeHeader(const char* request, const std::string& body, const bool is_head_only_first) {
+    webserver::IncomingHttpMessage::sptr incoming;
+    size_t end = 0;
+    const base::CString data(request, ::strlen(request));
+    webserver::IncomingHttpMessage::Deserialize(incoming, data, end);
+
+    webserver::OutgoingHttpMessage response;
+    response.SetResponseCode(webserver::HTTP_OK);
+    response.AddHeader("Content-Type", "text/plain");
+    if (is_head_only_first) {
+      response.SetHeadOnly(true);
+    }
+    response.SetData(body.data(), body.size());
+    response.Compress(*incoming);
+    response.SetHeadOnly(true);
+    response.Serialize();
+
+    iovec segments[8];
+    const size_t count = response.GetSegments(0, segments, 8);
+    std::string header;
+    for (size_t i = 0; i < count; ++i) {
+      header.append(static_cast<const char*>(segments[i].iov_base), segments[i].iov_len);
+    }
+    return header;
+  }
+
+
+  void CheckHeadCompression() {
+    std::string body;
+    for (size_t i = 0; i < 1000; ++i) {
+      body.append("compressible ");
+    }
+
+    // Date line is the same within a second, it is formatted once.
+    const std::string get = SerializeHeader("GET / HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n", body, false);
+    const std::string head = SerializeHeader("HEAD / HTTP/1.1\r\nAccept-Encoding: gzip\r\n\r\n", body, true);
+    Check(get.find("Content-Encoding: gzip\r\n") != std::string::npos, "GET response is compressed");
+    Check(get == head, "HEAD response has the header of GET response");
+  }
+}
+
+
+int main() {
+  CheckFormatDecimal();
+  CheckLatencyBuckets();
+  CheckChunkedDecoder();
+  CheckQueryTokenizer();
+  CheckHeadCompression();
+
+  std::cout << checks - failures << " of " << checks << " checks passed" << std::endl;
+  return failures == 0 ? 0 : 1;
+}
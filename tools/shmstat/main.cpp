@@ -0,0 +1,113 @@
+// Shared status reader.
+//
+// Copyright 2010 LibWebserver Authors. All rights reserved.
+//
+// Prints status published with WebserverStatus::PublishTo(), once or every few seconds.
+
+#include <webserver/sharedstatus.h>
+
+#include <cstdlib>
+#include <iostream>
+
+extern "C" {
+#include <unistd.h>
+}
+
+
+namespace {
+  const char* const WINDOW_NAMES[webserver::LatencyWindows::WINDOWS_COUNT] = { "1m", "5m", "15m" };
+
+
+  void PrintLatency(const char* name, const webserver::LatencyPercentiles& latency) {
+    std::cout << "  " << name
+              << " n=" << latency.count
+              << " p50=" << latency.p50
+              << " p90=" << latency.p90
+              << " p99=" << latency.p99
+              << " p99.9=" << latency.p999
+              << " max=" << latency.max << std::endl;
+  }
+
+
+  void Print(const webserver::SharedStatusData& data) {
+    std::cout << "updated " << data.updated << std::endl;
+
+    std::cout << "responses";
+    for (unsigned int i = 0; i < webserver::HTTP_CODES_COUNT; ++i) {
+      std::cout << " " << webserver::HTTP_CODES[i][webserver::HTTP_CODE] << "=" << data.responses[i];
+    }
+    std::cout << std::endl;
+    std::cout << "traffic in=" << data.traffic_in << " out=" << data.traffic_out << std::endl;
+
+    for (size_t i = 0; i < webserver::LatencyWindows::WINDOWS_COUNT; ++i) {
+      std::cout << WINDOW_NAMES[i]
+                << " sustained=" << data.sustained_rate[i]
+                << " exponential=" << data.exponential_rate[i]
+                << " attained=" << data.attained_rate[i]
+                << " latency=" << data.latency[i] << "us" << std::endl;
+    }
+    std::cout << "max attained=" << data.max_attained_rate << " max latency=" << data.max_latency << "us" << std::endl;
+
+    std::cout << "latency percentiles, us" << std::endl;
+    for (size_t i = 0; i < webserver::LatencyWindows::WINDOWS_COUNT; ++i) {
+      PrintLatency(WINDOW_NAMES[i], data.latency_percentiles[i]);
+    }
+
+    std::cout << "request phases, us" << std::endl;
+    for (size_t i = webserver::PHASE_FIRST_BYTE; i < webserver::PHASES_COUNT; ++i) {
+      PrintLatency(webserver::PHASE_NAMES[i], data.phase_percentiles[i][webserver::LatencyWindows::WINDOW_1]);
+    }
+
+    std::cout << "connections accepted=" << data.connections_accepted << " rate=" << data.accept_rate << std::endl;
+    std::cout << "closed";
+    for (size_t i = 0; i < webserver::CLOSE_REASONS_COUNT; ++i) {
+      std::cout << " " << webserver::CLOSE_REASON_NAMES[i] << "=" << data.connections_closed[i] << "/" << data.close_rate[i];
+    }
+    std::cout << std::endl;
+    const double reuse = data.connection_requests != 0 ? 100.0 * data.reused_requests / data.connection_requests : 0;
+    std::cout << "requests=" << data.connection_requests << " reused=" << data.reused_requests
+              << " (" << reuse << "%)" << std::endl;
+    PrintLatency("requests per connection", data.requests_per_connection);
+    PrintLatency("connection age, ms", data.connection_age);
+
+    for (uint32_t i = 0; i < data.routes_count && i < webserver::SHARED_STATUS_MAX_ROUTES; ++i) {
+      const webserver::SharedRouteStatus& route = data.routes[i];
+      std::cout << "route " << route.prefix << " requests=" << route.requests
+                << " in=" << route.traffic_in << " out=" << route.traffic_out << std::endl;
+      PrintLatency("1m", route.latency);
+    }
+  }
+}
+
+
+int main(int argc, char** argv) {
+  if (argc < 2) {
+    std::cerr << "Usage: " << argv[0] << " <status file> [interval in seconds]" << std::endl;
+    return 1;
+  }
+
+  const unsigned int interval = argc > 2 ? static_cast<unsigned int>(::atoi(argv[2])) : 0;
+
+  webserver::SharedStatus status;
+  if (!status.Open(argv[1])) {
+    std::cerr << "Could not open status " << argv[1] << std::endl;
+    return 1;
+  }
+
+  static webserver::SharedStatusData data;
+  do {
+    if (status.Read(data)) {
+      Print(data);
+    }
+    else {
+      std::cerr << "Status is being updated, snapshot skipped." << std::endl;
+    }
+
+    if (interval != 0) {
+      std::cout << std::endl;
+      ::sleep(interval);
+    }
+  } while (interval != 0);
+
+  return 0;
+}